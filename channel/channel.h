@@ -8,23 +8,37 @@
 #ifndef CHANNEL_H_
 #define CHANNEL_H_
 
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <bit>
+#include <chrono>
+#include <cstdint>
 #include <memory>
-#include <mutex>
+#include <span>
+#include <thread>
 #include <tuple>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
+class Backoff;
+struct Futex;
+class Parker;
+class WaitQueue;
 class SpinLock;
 template<typename>
 class Guard;
 template<typename>
 class Queue;
-template<typename>
-class Sender;
-template<typename>
-class Receiver;
-template<typename T>
-std::tuple<Sender<T>, Receiver<T>> channel();
+template<typename T, bool MC = false>
+class Ring;
 
 // -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc
 // -fno-builtin-free
@@ -67,18 +81,6 @@ void dealloc(T *x)
 }
 #endif
 
-#ifdef SPIN
-using Mutex = SpinLock;
-template<typename T>
-using LockGuard = Guard<T>;
-using CondVar = std::condition_variable_any;
-#else
-using Mutex = std::mutex;
-template<typename T>
-using LockGuard = std::unique_lock<T>;
-using CondVar = std::condition_variable;
-#endif
-
 #ifdef TBB_QUEUE
 #include <tbb/concurrent_queue.h>
 template<typename T>
@@ -88,42 +90,266 @@ template<typename T>
 using Queue_t = Queue<T>;
 #endif
 
-class SpinLock {
+template<typename T, typename = Queue_t<T>>
+class Sender;
+template<typename T, typename = Queue_t<T>>
+class Receiver;
+template<typename T>
+std::tuple<Sender<T>, Receiver<T>> channel();
+template<typename T>
+std::tuple<Sender<T, Ring<T>>, Receiver<T, Ring<T>>>
+bounded_channel(size_t capacity);
+template<typename T>
+std::tuple<Sender<T, Ring<T, true>>, Receiver<T, Ring<T, true>>>
+mpmc_channel(size_t capacity);
+namespace nm::detail
+{
+struct SelectAccess;
+}
+
+// exponential backoff for busy waits, a few pause instructions first, then
+// the caller should block, or yield if it can't
+class Backoff {
 public:
-	SpinLock() : flag_ { 0 }
+	// false once spinning is unlikely to pay off
+	bool spin()
 	{
+		if (step_ > spin_limit || !smp())
+			return false;
+		for (unsigned i = 0; i < 1u << step_; ++i)
+			relax();
+		++step_;
+		return true;
 	}
 
-	~SpinLock()
+	void snooze()
 	{
-		flag_.clear(std::memory_order_release);
+		if (!spin())
+			std::this_thread::yield();
 	}
 
-	void try_lock()
+	static void relax()
 	{
-		flag_.test_and_set(std::memory_order_acquire);
+#if defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
 	}
 
-	void lock()
+private:
+	static constexpr unsigned spin_limit = 7;
+	unsigned step_ = 0;
+
+	// on a single cpu the thread we spin for can't run meanwhile
+	static bool smp()
+	{
+		static const bool ok = std::thread::hardware_concurrency() > 1;
+		return ok;
+	}
+};
+
+// sleep on a 32 bit word, std::atomic_ref wait and notify where there is no
+// futex, timed waits then nap in short steps
+struct Futex {
+	using clock = std::chrono::steady_clock;
+
+	// sleep while *word == expect, false if deadline has passed
+	static bool wait(uint32_t *word,
+			 uint32_t expect,
+			 const clock::time_point *deadline)
 	{
-		while (!flag_.test_and_set(std::memory_order_acquire))
+		auto left = clock::duration::zero();
+		if (deadline) {
+			left = *deadline - clock::now();
+			if (left <= clock::duration::zero())
+				return false;
+		}
+#ifdef __linux__
+		timespec ts {};
+		if (deadline) {
+			auto ns = std::chrono::duration_cast<
+					  std::chrono::nanoseconds>(left)
+					  .count();
+			ts.tv_sec = ns / 1000000000;
+			ts.tv_nsec = ns % 1000000000;
+		}
+		syscall(SYS_futex,
+			word,
+			FUTEX_WAIT_PRIVATE,
+			expect,
+			deadline ? &ts : nullptr,
+			nullptr,
+			0);
+#else
+		if (deadline)
+			std::this_thread::sleep_for(
+				std::min<clock::duration>(
+					left, std::chrono::milliseconds(1)));
+		else
+			std::atomic_ref<uint32_t>(*word).wait(expect);
+#endif
+		return true;
+	}
+
+	static void wake(uint32_t *word, bool all)
+	{
+#ifdef __linux__
+		syscall(SYS_futex,
+			word,
+			FUTEX_WAKE_PRIVATE,
+			all ? INT32_MAX : 1,
+			nullptr,
+			nullptr,
+			0);
+#else
+		if (all)
+			std::atomic_ref<uint32_t>(*word).notify_all();
+		else
+			std::atomic_ref<uint32_t>(*word).notify_one();
+#endif
+	}
+};
+
+// threads spin for a while, then sleep on a futex word until pred() holds,
+// a waker only enters the kernel when someone went to sleep since the last
+// wake, every sleeper is woken and those that lose the race sleep again
+//
+// the change that makes pred() true must be a seq_cst RMW, or be followed by
+// a seq_cst fence, before wake(), it pairs with the fence after a sleeper
+// registers so either the sleeper sees the change or the waker sees the
+// sleeper
+class Parker {
+public:
+	using clock = Futex::clock;
+
+	Parker() = default;
+	Parker(const Parker &) = delete;
+	Parker &operator=(const Parker &) = delete;
+
+	template<typename F>
+	void wait(F &&pred)
+	{
+		park(pred, nullptr);
+	}
+
+	// false if pred() still fails at deadline
+	template<typename F>
+	bool wait_until(F &&pred, clock::time_point deadline)
+	{
+		return park(pred, &deadline);
+	}
+
+	void wake()
+	{
+		auto w = word_.load();
+		while (sleepers(w) != 0) {
+			// bump the sequence and forget the sleepers, they are
+			// all on their way out
+			if (word_.compare_exchange_weak(w,
+							(w | UINT32_MAX) + 1)) {
+				Futex::wake(futex(), true);
+				return;
+			}
+		}
+	}
+
+	void wake_all()
+	{
+		wake();
+	}
+
+private:
+	// the futex word is the sequence in the high half, the low half
+	// counts sleepers registered since it last changed
+	std::atomic<uint64_t> word_ { 0 };
+
+	static uint32_t seq(uint64_t w)
+	{
+		return static_cast<uint32_t>(w >> 32);
+	}
+
+	static uint32_t sleepers(uint64_t w)
+	{
+		return static_cast<uint32_t>(w);
+	}
+
+	template<typename F>
+	bool park(F &pred, const clock::time_point *deadline)
+	{
+		for (Backoff b; b.spin();) {
+			if (pred())
+				return true;
+		}
+		for (;;) {
+			// a wake after this bumps the sequence, the futex then
+			// returns at once instead of sleeping
+			auto s = seq(word_.fetch_add(1));
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto ok = pred();
+			auto late = !ok && !Futex::wait(futex(), s, deadline);
+			leave(s);
+			if (ok)
+				return true;
+			if (late)
+				return pred();
+		}
+	}
+
+	// drop our registration unless a wake already did
+	void leave(uint32_t s)
+	{
+		auto w = word_.load(std::memory_order_relaxed);
+		while (seq(w) == s &&
+		       !word_.compare_exchange_weak(
+			       w, w - 1, std::memory_order_relaxed))
 			;
 	}
 
+	// the high half of word_
+	uint32_t *futex()
+	{
+		auto p = reinterpret_cast<uint32_t *>(&word_);
+		return std::endian::native == std::endian::little ? p + 1 : p;
+	}
+};
+
+class SpinLock {
+public:
+	SpinLock() = default;
+	SpinLock(const SpinLock &) = delete;
+	SpinLock &operator=(const SpinLock &) = delete;
+
+	bool try_lock()
+	{
+		return !flag_.test_and_set(std::memory_order_acquire);
+	}
+
+	// retry the RMW only once the lock looks free, the line stays shared
+	// while waiting
+	void lock()
+	{
+		for (Backoff b; !try_lock();) {
+			while (flag_.test(std::memory_order_relaxed))
+				b.snooze();
+		}
+	}
+
 	void unlock()
 	{
 		flag_.clear(std::memory_order_release);
 	}
 
 private:
-	std::atomic_flag flag_;
+	std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
 };
 
 template<typename T>
 class Guard {
 public:
-	Guard(T &lk) : lk_(lk)
+	explicit Guard(T &lk) : lk_(lk)
 	{
+		lk_.lock();
 	}
 
 	~Guard()
@@ -131,18 +357,139 @@ public:
 		lk_.unlock();
 	}
 
-	void lock()
+	Guard(const Guard &) = delete;
+	Guard &operator=(const Guard &) = delete;
+
+private:
+	T &lk_;
+};
+
+// like Parker, but waiters line up and each sleeps on a word of its own,
+// wake() hands one wakeup to the waiter that has been idle longest, so
+// consumers take turns instead of all racing for every message
+class WaitQueue {
+public:
+	using clock = Futex::clock;
+
+	WaitQueue() = default;
+	WaitQueue(const WaitQueue &) = delete;
+	WaitQueue &operator=(const WaitQueue &) = delete;
+
+	template<typename F>
+	void wait(F &&pred)
 	{
-		lk_.lock();
+		park(pred, nullptr);
 	}
 
-	void unlock()
+	// false if pred() still fails at deadline
+	template<typename F>
+	bool wait_until(F &&pred, clock::time_point deadline)
 	{
-		lk_.unlock();
+		return park(pred, &deadline);
+	}
+
+	void wake()
+	{
+		if (waiting_.load() == 0)
+			return;
+		Guard<SpinLock> g(lock_);
+		if (head_)
+			signal(unlink(head_));
+	}
+
+	void wake_all()
+	{
+		if (waiting_.load() == 0)
+			return;
+		Guard<SpinLock> g(lock_);
+		while (head_)
+			signal(unlink(head_));
 	}
 
 private:
-	T &lk_;
+	struct Waiter {
+		uint32_t woken = 0; // futex word, set under lock_
+		Waiter *prev = nullptr;
+		Waiter *next = nullptr;
+	};
+
+	SpinLock lock_;
+	Waiter *head_ = nullptr;
+	Waiter *tail_ = nullptr;
+	std::atomic<uint32_t> waiting_ { 0 };
+
+	template<typename F>
+	bool park(F &pred, const clock::time_point *deadline)
+	{
+		for (Backoff b; b.spin();) {
+			if (pred())
+				return true;
+		}
+		for (;;) {
+			Waiter w;
+			enqueue(&w);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto ok = pred();
+			auto late = !ok && !sleep(w, deadline);
+			// a wakeup we took but won't use goes to the next one
+			if (leave(&w) && (ok || late))
+				wake();
+			if (ok)
+				return true;
+			if (late)
+				return pred();
+		}
+	}
+
+	bool sleep(Waiter &w, const clock::time_point *deadline)
+	{
+		auto word = std::atomic_ref<uint32_t>(w.woken);
+		while (word.load(std::memory_order_acquire) == 0) {
+			if (!Futex::wait(&w.woken, 0, deadline))
+				return false;
+		}
+		return true;
+	}
+
+	void enqueue(Waiter *w)
+	{
+		Guard<SpinLock> g(lock_);
+		w->prev = tail_;
+		if (tail_)
+			tail_->next = w;
+		else
+			head_ = w;
+		tail_ = w;
+		waiting_.fetch_add(1);
+	}
+
+	// true if w was woken, a waker unlinks it, otherwise we do, either way
+	// w is not touched by anyone once this returns
+	bool leave(Waiter *w)
+	{
+		Guard<SpinLock> g(lock_);
+		if (std::atomic_ref<uint32_t>(w->woken).load(
+			    std::memory_order_relaxed))
+			return true;
+		unlink(w);
+		return false;
+	}
+
+	Waiter *unlink(Waiter *w)
+	{
+		(w->prev ? w->prev->next : head_) = w->next;
+		(w->next ? w->next->prev : tail_) = w->prev;
+		waiting_.fetch_sub(1, std::memory_order_relaxed);
+		return w;
+	}
+
+	// the waiter can't leave while we hold lock_
+	static void signal(Waiter *w)
+	{
+		std::atomic_ref<uint32_t>(w->woken).store(
+			1, std::memory_order_release);
+		Futex::wake(&w->woken, false);
+	}
 };
 
 template<typename T>
@@ -176,9 +523,11 @@ public:
 		tail_ = nullptr;
 	}
 
+	// false as soon as a push swapped head_, its node may not be linked
+	// yet
 	bool empty() const
 	{
-		return tail_->next.load(std::memory_order_acquire) == nullptr;
+		return head_.load() == tail_;
 	}
 
 	void push(const T &data)
@@ -186,7 +535,7 @@ public:
 		auto tmp = alloc<Node>();
 		tmp->data = data;
 		tmp->next.store(nullptr, std::memory_order_relaxed);
-		auto old_head = head_.exchange(tmp, std::memory_order_acq_rel);
+		auto old_head = head_.exchange(tmp);
 		old_head->next.store(tmp, std::memory_order_release);
 	}
 
@@ -195,10 +544,32 @@ public:
 		auto tmp = alloc<Node>();
 		tmp->data = std::move(data);
 		tmp->next.store(nullptr, std::memory_order_relaxed);
-		auto old_head = head_.exchange(tmp, std::memory_order_acq_rel);
+		auto old_head = head_.exchange(tmp);
 		old_head->next.store(tmp, std::memory_order_release);
 	}
 
+	// link the nodes first, then publish them with a single exchange
+	void push(std::span<T> data)
+	{
+		if (data.empty())
+			return;
+		Node *first = nullptr;
+		Node *last = nullptr;
+		for (auto &x : data) {
+			auto tmp = alloc<Node>();
+			tmp->data = std::move(x);
+			tmp->next.store(nullptr, std::memory_order_relaxed);
+			if (last)
+				last->next.store(tmp,
+						 std::memory_order_relaxed);
+			else
+				first = tmp;
+			last = tmp;
+		}
+		auto old_head = head_.exchange(last);
+		old_head->next.store(first, std::memory_order_release);
+	}
+
 	bool try_pop(T &data)
 	{
 		auto next = tail_->next.load(std::memory_order_acquire);
@@ -215,16 +586,190 @@ private:
 	Node *tail_;
 };
 
-// tbbmalloc + spinlock > jemalloc + spinlock > glibc malloc + spinlock
-// spinlock > std::mutex
-template<typename T>
+// bounded ring by Dmitry Vyukov, every cell carries a sequence number telling
+// whether it's ready for the next push or the next pop, slots are allocated
+// once, no allocation per message, MC allows more than one consumer
+template<typename T, bool MC>
+class Ring {
+private:
+	static constexpr size_t cache_line = 64;
+
+	struct Cell {
+		std::atomic<size_t> seq;
+		alignas(T) unsigned char data[sizeof(T)];
+
+		T *get()
+		{
+			return std::launder(reinterpret_cast<T *>(data));
+		}
+	};
+
+public:
+	static constexpr bool multi_consumer = MC;
+
+	// capacity is rounded up to a power of two
+	explicit Ring(size_t capacity)
+		: mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+		, cells_(new Cell[mask_ + 1])
+	{
+		for (size_t i = 0; i <= mask_; ++i) {
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+		}
+		head_.store(0, std::memory_order_relaxed);
+		tail_.store(0, std::memory_order_relaxed);
+	}
+
+	Ring(const Ring &) = delete;
+	Ring &operator=(const Ring &) = delete;
+
+	~Ring()
+	{
+		auto head = head_.load(std::memory_order_relaxed);
+		auto tail = tail_.load(std::memory_order_relaxed);
+		for (; head != tail; ++head) {
+			std::destroy_at(cells_[head & mask_].get());
+		}
+	}
+
+	size_t capacity() const
+	{
+		return mask_ + 1;
+	}
+
+	// approximate while producers are active
+	size_t size() const
+	{
+		auto tail = tail_.load(std::memory_order_relaxed);
+		auto head = head_.load(std::memory_order_relaxed);
+		return tail - head <= mask_ + 1 ? tail - head : 0;
+	}
+
+	// false as soon as a push claims a slot, which may not be readable
+	// yet
+	bool empty() const
+	{
+		return tail_.load() == head_.load();
+	}
+
+	// data is moved from only on success, false if full
+	bool try_push(T &&data)
+	{
+		auto pos = tail_.load(std::memory_order_relaxed);
+		Cell *c;
+		for (;;) {
+			c = &cells_[pos & mask_];
+			auto seq = c->seq.load(std::memory_order_acquire);
+			auto dif = static_cast<intptr_t>(seq - pos);
+			if (dif == 0) {
+				if (tail_.compare_exchange_weak(pos, pos + 1))
+					break;
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+		std::construct_at(c->get(), std::move(data));
+		c->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// claim as many free slots as possible, up to data.size(), with one
+	// CAS, return how many elements are moved in
+	size_t try_push(std::span<T> data)
+	{
+		auto pos = tail_.load(std::memory_order_relaxed);
+		size_t n = 0;
+		while (!data.empty()) {
+			for (n = 0; n < data.size(); ++n) {
+				auto &c = cells_[(pos + n) & mask_];
+				if (c.seq.load(std::memory_order_acquire) !=
+				    pos + n)
+					break;
+			}
+			if (n == 0) {
+				auto &c = cells_[pos & mask_];
+				auto s = c.seq.load(std::memory_order_acquire);
+				// not yet popped in the last lap
+				if (static_cast<intptr_t>(s - pos) < 0)
+					return 0;
+				pos = tail_.load(std::memory_order_relaxed);
+			} else if (tail_.compare_exchange_weak(pos, pos + n)) {
+				break;
+			}
+		}
+		for (size_t i = 0; i < n; ++i) {
+			auto &c = cells_[(pos + i) & mask_];
+			std::construct_at(c.get(), std::move(data[i]));
+			c.seq.store(pos + i + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	bool try_pop(T &data)
+	{
+		auto pos = head_.load(std::memory_order_relaxed);
+		Cell *c;
+		for (;;) {
+			c = &cells_[pos & mask_];
+			auto seq = c->seq.load(std::memory_order_acquire);
+			auto dif = static_cast<intptr_t>(seq - (pos + 1));
+			if (dif == 0) {
+				if constexpr (!MC) {
+					head_.store(pos + 1,
+						    std::memory_order_relaxed);
+					break;
+				}
+				if (head_.compare_exchange_weak(
+					    pos,
+					    pos + 1,
+					    std::memory_order_relaxed))
+					break;
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = head_.load(std::memory_order_relaxed);
+			}
+		}
+		data = std::move(*c->get());
+		std::destroy_at(c->get());
+		c->seq.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	const size_t mask_;
+	std::unique_ptr<Cell[]> cells_;
+	// producers and consumers never share a line
+	alignas(cache_line) std::atomic<size_t> tail_;
+	alignas(cache_line) std::atomic<size_t> head_;
+	char pad_[cache_line - sizeof(std::atomic<size_t>)];
+};
+
+// tbbmalloc > jemalloc > glibc malloc
+//
+// both sides spin briefly, then sleep on a Parker, nothing is locked on the
+// way, a message costs the sender one load to find out if the receiver sleeps,
+// receivers of a multi consumer queue wait in line on a WaitQueue instead
+template<typename T, typename Q>
 class ReceiverImpl {
 private:
-	ReceiverImpl() = default;
+	template<typename... Args>
+	explicit ReceiverImpl(Args &&...args)
+		: queue_(std::forward<Args>(args)...)
+	{
+	}
 
 public:
 	template<typename U>
 	friend std::tuple<Sender<U>, Receiver<U>> channel();
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U>>, Receiver<U, Ring<U>>>
+	bounded_channel(size_t);
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U, true>>, Receiver<U, Ring<U, true>>>
+	mpmc_channel(size_t);
+	friend struct nm::detail::SelectAccess;
 
 	ReceiverImpl(const ReceiverImpl &) = delete;
 
@@ -232,66 +777,306 @@ public:
 
 	ReceiverImpl(ReceiverImpl &&rhs) = delete;
 
+	static constexpr bool multi = requires { requires Q::multi_consumer; };
+
 	~ReceiverImpl() = default;
 
-	void send(const T &data)
+	// false if the receiver is gone, data is then left untouched, block
+	// while a bounded queue is full
+	bool send(const T &data)
 	{
-		queue_.push(data);
-		if (!state_) {
-			cond_.notify_one();
-		}
+		return send(T(data));
+	}
+
+	bool send(T &&data)
+	{
+		if (gone_.load(std::memory_order_relaxed))
+			return false;
+		if (!push(data) && !make_room([&] { return push(data); }))
+			return false;
+		notify();
+		return true;
 	}
 
-	void send(T &&data)
+	bool try_send(T &&data)
+	{
+		if (gone_.load(std::memory_order_relaxed) || !push(data))
+			return false;
+		notify();
+		return true;
+	}
+
+	template<typename Rep, typename Period>
+	bool send_timeout(T &&data,
+			  const std::chrono::duration<Rep, Period> &timeout)
 	{
-		queue_.push(std::move(data));
-		if (!state_) {
-			cond_.notify_one();
+		if (gone_.load(std::memory_order_relaxed))
+			return false;
+		auto deadline = deadline_after(timeout);
+		if (!push(data) &&
+		    !make_room([&] { return push(data); }, &deadline))
+			return false;
+		notify();
+		return true;
+	}
+
+	// a bounded queue takes what fits, the receiver is woken once per
+	// chunk rather than once per element
+	bool send_batch(std::span<T> data)
+	{
+		if (gone_.load(std::memory_order_relaxed))
+			return false;
+		size_t n = push(data);
+		while (n < data.size()) {
+			if (n)
+				notify();
+			auto more = [&] {
+				auto k = push(data.subspan(n));
+				n += k;
+				return k > 0;
+			};
+			if (!make_room(more))
+				return false;
 		}
+		notify();
+		return true;
 	}
 
 	bool try_recv(T &data)
 	{
-		return queue_.try_pop(data);
+		return pop(data);
 	}
 
-	void recv(T &data)
+	// false once every sender is gone and nothing is left
+	bool recv(T &data)
 	{
-		for (;;) {
-			if (!state_) {
-				LockGuard<Mutex> lk(mtx_);
-				cond_.wait(lk,
-					   [this] { return !queue_.empty(); });
-			}
-			if (queue_.try_pop(data)) {
-				state_ = true;
-				break;
-			}
-			state_ = false;
+		// a claimed slot that is not written yet is worth a short wait
+		// only, the sender is in the middle of a push
+		for (Backoff b; !pop(data);) {
+			if (!queue_.empty())
+				b.snooze();
+			else if (senders_.load() == 0)
+				return pop(data);
+			else
+				ready_.wait([this] { return readable(); });
 		}
+		return true;
 	}
 
 	template<typename Rep, typename Period>
 	bool recv_timeout(T &data,
 			  const std::chrono::duration<Rep, Period> &timeout)
 	{
-		LockGuard<Mutex> lk(mtx_);
-		cond_.wait_for(lk, timeout, [this] { return !queue_.empty(); });
-		return queue_.try_pop(data);
+		auto deadline = deadline_after(timeout);
+		for (Backoff b; !pop(data);) {
+			if (!queue_.empty())
+				b.snooze();
+			else if (senders_.load() == 0 ||
+				 !ready_.wait_until(
+					 [this] { return readable(); },
+					 deadline))
+				return pop(data);
+		}
+		return true;
+	}
+
+	// block until something arrives, then take all that's there up to
+	// max, 0 once disconnected
+	size_t recv_batch(std::vector<T> &out, size_t max)
+	{
+		if (max == 0)
+			return 0;
+		out.emplace_back();
+		if (!recv(out.back())) {
+			out.pop_back();
+			return 0;
+		}
+		size_t n = 1;
+		while (n < max) {
+			out.emplace_back();
+			if (!queue_.try_pop(out.back())) {
+				out.pop_back();
+				break;
+			}
+			++n;
+		}
+		freed();
+		return n;
+	}
+
+	// every sender is gone and nothing is left to receive
+	bool disconnected() const
+	{
+		return senders_.load() == 0 && queue_.empty();
+	}
+
+	void attach()
+	{
+		senders_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// the last sender out wakes every receiver, the RMW is what Parker
+	// asks for
+	void detach()
+	{
+		if (senders_.fetch_sub(1) == 1)
+			notify(true);
+	}
+
+	void attach_receiver()
+	{
+		receivers_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// once the last receiver is gone senders blocked on a full queue give
+	// up
+	void detach_receiver()
+	{
+		if (receivers_.fetch_sub(1) == 1) {
+			gone_.exchange(true);
+			space_.wake();
+		}
 	}
 
 private:
-	Queue_t<T> queue_;
-	Mutex mtx_;
-	CondVar cond_;
-	bool state_ { false };
+	static constexpr size_t cache_line = 64;
+
+	Q queue_;
+	// the receiver sleeps on ready_, blocked senders on space_, a select
+	// sleeps on its own Parker listed in watchers_
+	alignas(cache_line) std::conditional_t<multi, WaitQueue, Parker> ready_;
+	std::atomic<uint32_t> watching_ { 0 };
+	std::atomic<size_t> senders_ { 0 };
+	std::atomic<size_t> receivers_ { 1 };
+	std::atomic<bool> gone_ { false }; // every receiver was dropped
+	alignas(cache_line) Parker space_;
+	SpinLock watch_lock_;
+	std::vector<Parker *> watchers_;
+
+	static constexpr bool bounded =
+		requires(Q &q, T &&data) { q.try_push(std::move(data)); };
+
+	template<typename Rep, typename Period>
+	static Parker::clock::time_point
+	deadline_after(const std::chrono::duration<Rep, Period> &timeout)
+	{
+		return Parker::clock::now() +
+		       std::chrono::duration_cast<Parker::clock::duration>(
+			       timeout);
+	}
+
+	// wait until push_some() makes progress, false if the receiver went
+	// away or the deadline passed first
+	template<typename F>
+	bool make_room(F &&push_some,
+		       const Parker::clock::time_point *deadline = nullptr)
+	{
+		auto ok = false;
+		auto pred = [&] { return (ok = push_some()) || gone_.load(); };
+		if (deadline)
+			space_.wait_until(pred, *deadline);
+		else
+			space_.wait(pred);
+		return ok;
+	}
+
+	bool readable() const
+	{
+		return !queue_.empty() || senders_.load() == 0;
+	}
+
+	// the load of watching_ pairs with the increment in watch() the same
+	// way Parker does, the lock keeps a watcher alive while it's woken
+	void notify(bool all = false)
+	{
+		if (all)
+			ready_.wake_all();
+		else
+			ready_.wake();
+		if (watching_.load() != 0) {
+			Guard<SpinLock> g(watch_lock_);
+			for (auto p : watchers_)
+				p->wake();
+		}
+	}
+
+	void watch(Parker *p)
+	{
+		Guard<SpinLock> g(watch_lock_);
+		watchers_.push_back(p);
+		watching_.fetch_add(1);
+	}
+
+	void unwatch(Parker *p)
+	{
+		Guard<SpinLock> g(watch_lock_);
+		std::erase(watchers_, p);
+		watching_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	bool ready() const
+	{
+		return !queue_.empty();
+	}
+
+	// an unbounded queue is never full
+	bool push(T &data)
+	{
+		if constexpr (bounded) {
+			return queue_.try_push(std::move(data));
+		} else {
+			queue_.push(std::move(data));
+			return true;
+		}
+	}
+
+	size_t push(std::span<T> data)
+	{
+		if constexpr (bounded) {
+			return queue_.try_push(data);
+		} else if constexpr (requires { queue_.push(data); }) {
+			queue_.push(data);
+			return data.size();
+		} else {
+			for (auto &x : data)
+				queue_.push(std::move(x));
+			return data.size();
+		}
+	}
+
+	bool pop(T &data)
+	{
+		if (!queue_.try_pop(data))
+			return false;
+		freed();
+		return true;
+	}
+
+	// blocked senders are woken once half of the ring is free instead of
+	// once per slot, a pop is a plain store so it needs the fence Parker
+	// asks for
+	void freed()
+	{
+		if constexpr (bounded) {
+			if (queue_.size() > queue_.capacity() / 2)
+				return;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			space_.wake();
+		}
+	}
 };
 
-template<typename T>
+template<typename T, typename Q>
 class Sender {
 public:
 	template<typename U>
 	friend std::tuple<Sender<U>, Receiver<U>> channel();
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U>>, Receiver<U, Ring<U>>>
+	bounded_channel(size_t);
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U, true>>, Receiver<U, Ring<U, true>>>
+	mpmc_channel(size_t);
 
 	Sender(Sender &&rhs)
 	{
@@ -299,45 +1084,96 @@ public:
 		rhs.sender_.reset();
 	}
 
-	~Sender() = default;
+	~Sender()
+	{
+		close();
+	}
+
+	// block while a bounded channel is full, false if the receiver is
+	// gone or this sender is closed
+	bool send(const T &data)
+	{
+		return sender_ && sender_->send(data);
+	}
+
+	bool send(T &&data)
+	{
+		return sender_ && sender_->send(std::move(data));
+	}
+
+	// false if a bounded channel is full, the receiver is gone or this
+	// sender is closed, data is left untouched
+	bool try_send(T &&data)
+	{
+		return sender_ && sender_->try_send(std::move(data));
+	}
 
-	void send(const T &data)
+	bool try_send(const T &data)
+	{
+		return sender_ && sender_->try_send(T(data));
+	}
+
+	template<typename Rep, typename Period>
+	bool send_timeout(T &&data,
+			  const std::chrono::duration<Rep, Period> &timeout)
 	{
-		sender_->send(data);
+		return sender_ &&
+		       sender_->send_timeout(std::move(data), timeout);
 	}
 
-	void send(T &&data)
+	// elements are moved out, blocks like send for what doesn't fit
+	bool send_batch(std::span<T> data)
 	{
-		sender_->send(std::move(data));
+		return sender_ && sender_->send_batch(data);
 	}
 
+	// a clone of a closed sender is closed too
 	Sender clone()
 	{
 		return *this;
 	}
 
+	// drop this sender, the receiver is disconnected once the last one is
+	// closed or destroyed, sending afterwards fails
+	void close()
+	{
+		if (sender_) {
+			sender_->detach();
+			sender_.reset();
+		}
+	}
+
 private:
-	Sender(std::shared_ptr<ReceiverImpl<T>> recv) : sender_(recv)
+	Sender(std::shared_ptr<ReceiverImpl<T, Q>> recv) : sender_(recv)
 	{
+		sender_->attach();
 	}
 
 	Sender(const Sender &rhs)
 	{
-		if (this != &rhs) {
+		if (this != &rhs && rhs.sender_) {
 			sender_ = rhs.sender_;
+			sender_->attach();
 		}
 	}
 
 	Sender &operator=(const Sender &) = delete;
 
-	std::shared_ptr<ReceiverImpl<T>> sender_;
+	std::shared_ptr<ReceiverImpl<T, Q>> sender_;
 };
 
-template<typename T>
+template<typename T, typename Q>
 class Receiver {
 public:
 	template<typename U>
 	friend std::tuple<Sender<U>, Receiver<U>> channel();
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U>>, Receiver<U, Ring<U>>>
+	bounded_channel(size_t);
+	template<typename U>
+	friend std::tuple<Sender<U, Ring<U, true>>, Receiver<U, Ring<U, true>>>
+	mpmc_channel(size_t);
+	friend struct nm::detail::SelectAccess;
 
 	Receiver(Receiver &&rhs)
 	{
@@ -347,11 +1183,26 @@ public:
 		}
 	}
 
-	~Receiver() = default;
+	// senders blocked on a full channel give up once the last receiver is
+	// gone
+	~Receiver()
+	{
+		if (recv_)
+			recv_->detach_receiver();
+	}
 
-	void recv(T &data)
+	// receivers of an mpmc_channel share one queue, every message goes to
+	// exactly one of them
+	Receiver clone()
+		requires ReceiverImpl<T, Q>::multi
 	{
-		recv_->recv(data);
+		return *this;
+	}
+
+	// false once every sender is closed and nothing is left
+	bool recv(T &data)
+	{
+		return recv_->recv(data);
 	}
 
 	bool try_recv(T &data)
@@ -366,29 +1217,69 @@ public:
 		return recv_->recv_timeout(data, timeout);
 	}
 
+	// append at least one and at most max messages to out, blocking only
+	// until the first one arrives, 0 once disconnected
+	size_t recv_batch(std::vector<T> &out, size_t max)
+	{
+		return recv_->recv_batch(out, max);
+	}
+
+	// every sender is closed and nothing is left, try_recv and
+	// recv_timeout tell disconnect from empty with this
+	bool disconnected() const
+	{
+		return recv_->disconnected();
+	}
+
 private:
-	Receiver(ReceiverImpl<T> *recv) : recv_(recv)
+	Receiver(ReceiverImpl<T, Q> *recv) : recv_(recv)
 	{
 	}
 
-	Receiver(const Receiver &) = delete;
+	Receiver(const Receiver &rhs) : recv_(rhs.recv_)
+	{
+		recv_->attach_receiver();
+	}
 
 	Receiver &operator=(const Receiver &) = delete;
 
-	std::shared_ptr<ReceiverImpl<T>> get()
+	std::shared_ptr<ReceiverImpl<T, Q>> get()
 	{
 		return recv_;
 	}
 
-	std::shared_ptr<ReceiverImpl<T>> recv_;
+	std::shared_ptr<ReceiverImpl<T, Q>> recv_;
 };
 
 template<typename T>
 std::tuple<Sender<T>, Receiver<T>> channel()
 {
-	Receiver<T> receiver(new ReceiverImpl<T>());
+	Receiver<T> receiver(new ReceiverImpl<T, Queue_t<T>>());
 	Sender<T> sender(receiver.get());
 	return std::make_tuple(std::move(sender), std::move(receiver));
 }
 
+// senders block when capacity (rounded up to a power of two) messages are
+// in flight, the memory is allocated once
+template<typename T>
+std::tuple<Sender<T, Ring<T>>, Receiver<T, Ring<T>>>
+bounded_channel(size_t capacity)
+{
+	Receiver<T, Ring<T>> receiver(new ReceiverImpl<T, Ring<T>>(capacity));
+	Sender<T, Ring<T>> sender(receiver.get());
+	return std::make_tuple(std::move(sender), std::move(receiver));
+}
+
+// any number of receivers, see Receiver::clone(), idle ones are woken one at
+// a time in the order they went idle
+template<typename T>
+std::tuple<Sender<T, Ring<T, true>>, Receiver<T, Ring<T, true>>>
+mpmc_channel(size_t capacity)
+{
+	using Q = Ring<T, true>;
+	Receiver<T, Q> receiver(new ReceiverImpl<T, Q>(capacity));
+	Sender<T, Q> sender(receiver.get());
+	return std::make_tuple(std::move(sender), std::move(receiver));
+}
+
 #endif // CHANNEL_H_
@@ -0,0 +1,136 @@
+/*********************************************************
+	  File Name: select.h
+	  Author: Abby Cin
+	  Mail: abbytsing@gmail.com
+	  Created Time: Mon 19 Oct 2026 10:12:05 AM CST
+**********************************************************/
+
+#ifndef CHANNEL_SELECT_H_
+#define CHANNEL_SELECT_H_
+
+#include "channel.h"
+#include <optional>
+
+// wait on several receivers at once, the first one with a message has it
+// handed to its callback, receivers may carry different types
+//
+//	while (nm::select(nm::on(ctl, [&](Command c) { ... }),
+//			  nm::on(data, [&](Packet p) { ... })))
+//		;
+//	if (!nm::select_timeout(100ms, nm::on(timer, on_tick)))
+//		idle();
+//
+// a disconnected receiver never fires, once all of them are select returns
+// nullopt
+//
+// a select sleeps on one Parker of its own that every receiver wakes, when
+// several are ready the scan starts one past where the last select of this
+// thread started, so a busy receiver can't starve the others
+namespace nm
+{
+template<typename T, typename Q, typename F>
+struct Case {
+	Receiver<T, Q> &rx;
+	F f;
+};
+
+template<typename T, typename Q, typename F>
+Case<T, Q, F> on(Receiver<T, Q> &rx, F f)
+{
+	return { rx, std::move(f) };
+}
+
+namespace detail
+{
+	struct SelectAccess {
+		template<typename T, typename Q>
+		static ReceiverImpl<T, Q> &impl(Receiver<T, Q> &rx)
+		{
+			return *rx.recv_;
+		}
+
+		template<typename T, typename Q, typename F>
+		static bool fire(Case<T, Q, F> &c)
+		{
+			T data;
+			if (!impl(c.rx).try_recv(data))
+				return false;
+			c.f(std::move(data));
+			return true;
+		}
+
+		// one pass over the cases starting at start, the index of the
+		// one that fired or nullopt
+		template<typename... C>
+		static std::optional<size_t> poll(size_t start, C &...cs)
+		{
+			constexpr size_t n = sizeof...(C);
+			for (size_t k = 0; k < n; ++k) {
+				auto i = (start + k) % n;
+				size_t j = 0;
+				if ((((j++ == i) && fire(cs)) || ...))
+					return i;
+			}
+			return std::nullopt;
+		}
+
+		template<typename... C>
+		static std::optional<size_t>
+		select(const Parker::clock::time_point *deadline, C &...cs)
+		{
+			static thread_local size_t turn = 0;
+			auto start = turn++;
+			if (auto i = poll(start, cs...))
+				return i;
+
+			Parker parker;
+			(impl(cs.rx).watch(&parker), ...);
+			auto closed = [&] {
+				return (impl(cs.rx).disconnected() && ...);
+			};
+			auto ready = [&] {
+				return (impl(cs.rx).ready() || ...) || closed();
+			};
+			std::optional<size_t> r;
+			for (Backoff b;;) {
+				auto ok = true;
+				if (!deadline)
+					parker.wait(ready);
+				else
+					ok = parker.wait_until(ready,
+							       *deadline);
+				if ((r = poll(start, cs...)) || !ok || closed())
+					break;
+				// a slot is claimed but not written yet
+				b.snooze();
+			}
+			(impl(cs.rx).unwatch(&parker), ...);
+			return r;
+		}
+	};
+} // namespace detail
+
+// block until one of the cases receives, return its index, nullopt if all
+// are disconnected
+template<typename... C>
+std::optional<size_t> select(C... cases)
+{
+	static_assert(sizeof...(C) > 0, "nothing to select");
+	return detail::SelectAccess::select(nullptr, cases...);
+}
+
+// nullopt if nothing arrived in time or all are disconnected
+template<typename Rep, typename Period, typename... C>
+std::optional<size_t>
+select_timeout(const std::chrono::duration<Rep, Period> &timeout,
+	       C... cases)
+{
+	static_assert(sizeof...(C) > 0, "nothing to select");
+	auto deadline = Parker::clock::now() +
+			std::chrono::duration_cast<Parker::clock::duration>(
+				timeout);
+	return detail::SelectAccess::select(&deadline, cases...);
+}
+} // namespace nm
+
+#endif // CHANNEL_SELECT_H_
@@ -6,13 +6,20 @@
 **********************************************************/
 
 #include "channel.h"
+#include "select.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
-void sender(Sender<size_t> tx, size_t data, size_t limit)
+template<typename Q>
+void sender(Sender<size_t, Q> tx, size_t data, size_t limit)
 {
 	for (; limit > 0;) {
 		limit -= 1;
@@ -21,17 +28,13 @@ void sender(Sender<size_t> tx, size_t data, size_t limit)
 	printf("thread %lu done\n", data);
 }
 
-void receiver(Receiver<size_t> rx)
+template<typename Q>
+void receiver(Receiver<size_t, Q> rx)
 {
 	std::vector<size_t> vec(3, 0);
 	size_t res = 0;
-	for (;;) {
-		rx.recv(res);
-		if (res < vec.size())
-			vec[res] += 1;
-		else
-			break;
-	}
+	while (rx.recv(res))
+		vec[res] += 1;
 	for (size_t i = 0; i < vec.size(); ++i)
 		printf("thread %lu => %lu\n", i, vec[i]);
 	printf("receiver done.\n");
@@ -49,30 +52,240 @@ auto duration(const T &dur)
 		.count();
 }
 
-int main(int argc, char *argv[])
+template<typename Q>
+void bench(const char *name,
+	   std::tuple<Sender<size_t, Q>, Receiver<size_t, Q>> chan,
+	   size_t num)
 {
-	if (argc != 2) {
-		fprintf(stderr, "%s num\n", argv[0]);
-		return 1;
+	auto &[tx, rx] = chan;
+	auto start = now();
+
+	std::thread rcv(receiver<Q>, std::move(rx));
+
+	std::vector<std::thread> pool;
+	for (int i = 0; i < 3; ++i) {
+		pool.emplace_back(sender<Q>, tx.clone(), i, num);
 	}
 
-	size_t num = std::stoull(argv[1]);
+	tx.close();
+	for (auto &x : pool)
+		x.join();
+	rcv.join();
+	auto end = now();
+	auto dur = static_cast<double>(duration(end - start));
+	printf("%s: %.9f\n", name, dur / 1000000000);
+}
 
-	auto [tx, rx] = channel<size_t>();
+template<typename Q>
+void batch_sender(Sender<size_t, Q> tx, size_t data, size_t limit, size_t n)
+{
+	std::vector<size_t> buf(n, data);
+	for (; limit >= n; limit -= n)
+		tx.send_batch(buf);
+	buf.resize(limit);
+	tx.send_batch(buf);
+}
+
+template<typename Q>
+void batch_receiver(Receiver<size_t, Q> rx, size_t &count)
+{
+	std::vector<size_t> out;
+	while (rx.recv_batch(out, 256)) {
+		count += out.size();
+		out.clear();
+	}
+}
+
+template<typename Q>
+void bench_batch(const char *name,
+		 std::tuple<Sender<size_t, Q>, Receiver<size_t, Q>> chan,
+		 size_t num,
+		 size_t n)
+{
+	auto &[tx, rx] = chan;
+	size_t count = 0;
 	auto start = now();
 
-	std::thread rcv(receiver, std::move(rx));
+	std::thread rcv(batch_receiver<Q>, std::move(rx), std::ref(count));
 
 	std::vector<std::thread> pool;
 	for (int i = 0; i < 3; ++i) {
-		pool.emplace_back(sender, tx.clone(), i, num);
+		pool.emplace_back(batch_sender<Q>, tx.clone(), i, num, n);
 	}
 
+	tx.close();
 	for (auto &x : pool)
 		x.join();
-	tx.send(309);
 	rcv.join();
-	auto end = now();
-	auto dur = static_cast<double>(duration(end - start));
-	printf("%.9f\n", dur / 1000000000);
+	auto dur = static_cast<double>(duration(now() - start));
+	printf("%s batch %3lu: %lu msgs, %.2f M msgs/s\n",
+	       name,
+	       n,
+	       count,
+	       count / dur * 1000);
+}
+
+// spend roughly the same time on every message
+size_t work(size_t x)
+{
+	for (int i = 0; i < 200; ++i)
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+	return x;
+}
+
+// one queue fanned out to a pool of consumers
+void bench_mpmc(size_t num, size_t consumers)
+{
+	auto [tx, rx] = mpmc_channel<size_t>(1024);
+	std::atomic<size_t> count { 0 };
+	std::atomic<size_t> sink { 0 };
+	auto start = now();
+
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < consumers; ++i) {
+		pool.emplace_back([&, rx = rx.clone()]() mutable {
+			size_t x;
+			size_t n = 0;
+			size_t h = 0;
+			while (rx.recv(x)) {
+				h ^= work(x);
+				n += 1;
+			}
+			count += n;
+			sink ^= h;
+		});
+	}
+	std::vector<std::thread> producers;
+	for (size_t i = 0; i < 3; ++i) {
+		producers.emplace_back([tx = tx.clone(), num]() mutable {
+			for (size_t j = 0; j < num; ++j)
+				tx.send(j);
+		});
+	}
+	tx.close();
+	for (auto &x : producers)
+		x.join();
+	for (auto &x : pool)
+		x.join();
+	auto dur = static_cast<double>(duration(now() - start));
+	printf("mpmc %lu consumers: %lu msgs, %.2f M msgs/s\n",
+	       consumers,
+	       count.load(),
+	       count / dur * 1000);
+}
+
+// the mutex and condition variable handoff channel used to be built on, for
+// comparison
+template<typename T>
+class CondChannel {
+public:
+	void send(const T &data)
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			queue_.push_back(data);
+		}
+		cond_.notify_one();
+	}
+
+	void recv(T &data)
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		cond_.wait(lk, [this] { return !queue_.empty(); });
+		data = queue_.front();
+		queue_.pop_front();
+	}
+
+private:
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	std::deque<T> queue_;
+};
+
+// time from send to the return of recv, with a gap between messages so the
+// receiver has gone idle every time
+template<typename Tx, typename Rx>
+void latency(const char *name, Tx &tx, Rx &rx, size_t rounds)
+{
+	std::vector<int64_t> lat(rounds);
+	auto base = now();
+	std::thread rcv([&] {
+		int64_t ts = 0;
+		for (auto &x : lat) {
+			rx.recv(ts);
+			x = duration(now() - base) - ts;
+		}
+	});
+	for (size_t i = 0; i < rounds; ++i) {
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+		tx.send(duration(now() - base));
+	}
+	rcv.join();
+	std::sort(lat.begin(), lat.end());
+	printf("%s handoff: p50 %ldns p99 %ldns\n",
+	       name,
+	       lat[rounds / 2],
+	       lat[rounds * 99 / 100]);
+}
+
+// one dispatcher serving a data and a control channel of different types,
+// it stops when the producer is done with both
+void dispatch(size_t num)
+{
+	auto [tx, rx] = bounded_channel<size_t>(1024);
+	auto [ctl_tx, ctl_rx] = channel<std::string>();
+	auto start = now();
+
+	std::thread producer([tx = std::move(tx),
+			      ctl_tx = std::move(ctl_tx),
+			      num]() mutable {
+		for (size_t i = 0; i < num; ++i)
+			tx.send(i);
+		ctl_tx.send("flush");
+	});
+
+	size_t count = 0;
+	size_t flush = 0;
+	while (nm::select(nm::on(rx, [&](size_t) { count += 1; }),
+			  nm::on(ctl_rx,
+				 [&](const std::string &) { flush += 1; })))
+		;
+	producer.join();
+	auto dur = static_cast<double>(duration(now() - start));
+
+	printf("select: %lu msgs, %lu flush, %.2f M msgs/s, %s\n",
+	       count,
+	       flush,
+	       count / dur * 1000,
+	       rx.disconnected() ? "disconnected" : "open");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "%s num\n", argv[0]);
+		return 1;
+	}
+
+	size_t num = std::stoull(argv[1]);
+
+	bench("unbounded", channel<size_t>(), num);
+	bench("bounded 1024", bounded_channel<size_t>(1024), num);
+
+	for (size_t n : { 1, 4, 16, 64, 256 }) {
+		bench_batch("unbounded", channel<size_t>(), num, n);
+		bench_batch("bounded", bounded_channel<size_t>(1024), num, n);
+	}
+
+	dispatch(num);
+
+	for (size_t n : { 1, 2, 4, 8 })
+		bench_mpmc(num, n);
+
+	CondChannel<int64_t> cond;
+	latency("condvar", cond, cond, 10000);
+	auto [tx, rx] = channel<int64_t>();
+	latency("unbounded", tx, rx, 10000);
+	auto [btx, brx] = bounded_channel<int64_t>(1024);
+	latency("bounded", btx, brx, 10000);
 }
@@ -0,0 +1,602 @@
+/***********************************************
+	File Name: binary.h
+	Author: Abby Cin
+	Mail: abbytsing@gmail.com
+	Created Time: 10/18/26 9:30 PM
+***********************************************/
+
+#ifndef JSON_BINARY_H_
+#define JSON_BINARY_H_
+
+#include "json.h"
+#include <bit>
+#include <optional>
+
+// a compact binary form of the json data model for service to service hops,
+// every value starts with a one byte tag:
+//
+//	null, false, true	tag only
+//	number			8 bytes IEEE 754 double
+//	integer, uinteger	LEB128 varint, zigzag for integer
+//	raw, string		varint byte length, bytes (not escaped)
+//	array, object		u32 payload length, varint count, members
+//
+// object members are a string body (length, bytes) followed by a value, a
+// container can be skipped by its payload length without looking inside
+//
+//	std::string buf;
+//	nm::json::binary::encode(dom, buf);
+//	auto v = nm::json::binary::decode(buf);		// JsonValue
+//	nm::json::binary::Value lazy { buf };
+//	auto city = lazy[42]["profile"]["city"].get_string();
+//
+// NOTE: numbers and lengths are little endian, lengths are limited to 4GB
+namespace nm::json::binary
+{
+enum Tag : uint8_t {
+	null_tag = 0,
+	false_tag,
+	true_tag,
+	number_tag,
+	integer_tag,
+	uinteger_tag,
+	raw_tag,
+	string_tag,
+	array_tag,
+	object_tag,
+};
+
+namespace detail
+{
+	template<typename Sink>
+	void put_varint(Sink &out, uint64_t v)
+	{
+		char buf[10];
+		size_t n = 0;
+		while (v >= 0x80) {
+			buf[n++] = static_cast<char>(v | 0x80);
+			v >>= 7;
+		}
+		buf[n++] = static_cast<char>(v);
+		out.append(buf, n);
+	}
+
+	template<typename Sink>
+	void put_bytes(Sink &out, Tag tag, std::string_view s)
+	{
+		out.push_back(static_cast<char>(tag));
+		put_varint(out, s.size());
+		out.append(s.data(), s.size());
+	}
+
+	// the sink must be random access to patch the length
+	template<typename Sink>
+	bool encode(const JsonValue &v, Sink &out, size_t depth)
+	{
+		if (json::detail::too_deep(depth)) {
+			return false;
+		}
+		if (auto s = v.as<string_t>()) {
+			put_bytes(out, string_tag, *s);
+		} else if (auto i = v.as<int_t>()) {
+			out.push_back(static_cast<char>(integer_tag));
+			auto u = static_cast<uint_t>(*i);
+			auto sign = static_cast<uint_t>(*i >> 63);
+			put_varint(out, (u << 1) ^ sign);
+		} else if (auto d = v.as<number_t>()) {
+			char buf[9] = { static_cast<char>(number_tag) };
+			auto bits = std::bit_cast<uint64_t>(*d);
+			for (size_t i = 0; i < 8; ++i) {
+				buf[i + 1] = static_cast<char>(bits >> (i * 8));
+			}
+			out.append(buf, 9);
+		} else if (auto b = v.as<bool_t>()) {
+			auto t = *b ? true_tag : false_tag;
+			out.push_back(static_cast<char>(t));
+		} else if (v.is_null()) {
+			out.push_back(static_cast<char>(null_tag));
+		} else if (auto u = v.as<uint_t>()) {
+			out.push_back(static_cast<char>(uinteger_tag));
+			put_varint(out, *u);
+		} else if (auto r = v.as<raw_t>()) {
+			put_bytes(out, raw_tag, r->text);
+		} else {
+			auto a = v.as<array_t>();
+			auto o = v.as<object_t>();
+			if (!a && !o) {
+				return false;
+			}
+			auto t = a ? array_tag : object_tag;
+			out.push_back(static_cast<char>(t));
+			auto at = out.size();
+			out.append("\0\0\0\0", 4);
+			if (a) {
+				put_varint(out, a->size());
+				for (auto &x : *a) {
+					if (!encode(x, out, depth + 1)) {
+						return false;
+					}
+				}
+			} else {
+				put_varint(out, o->size());
+				for (auto &[k, x] : *o) {
+					put_varint(out, k.size());
+					out.append(k.data(), k.size());
+					if (!encode(x, out, depth + 1)) {
+						return false;
+					}
+				}
+			}
+			size_t len = out.size() - at - 4;
+			if (len > UINT32_MAX) {
+				return false;
+			}
+			for (size_t i = 0; i < 4; ++i) {
+				out[at + i] = static_cast<char>(len >> (i * 8));
+			}
+		}
+		return true;
+	}
+
+	// bounds checked reader over an encoded buffer
+	struct Reader {
+		std::string_view src_;
+
+		uint8_t at(size_t off) const
+		{
+			if (off >= src_.size()) {
+				return 0xff;
+			}
+			return static_cast<uint8_t>(src_[off]);
+		}
+
+		// value and offset past it, nullopt if truncated or too long
+		std::optional<uint64_t> varint(size_t &off) const
+		{
+			uint64_t v = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				if (off >= src_.size()) {
+					return std::nullopt;
+				}
+				auto c = static_cast<uint8_t>(src_[off++]);
+				v |= static_cast<uint64_t>(c & 0x7f) << shift;
+				if (!(c & 0x80)) {
+					return v;
+				}
+			}
+			return std::nullopt;
+		}
+
+		// bytes of a length prefixed body at off, off is moved past
+		std::optional<std::string_view> bytes(size_t &off) const
+		{
+			auto n = varint(off);
+			if (!n || *n > src_.size() - off) {
+				return std::nullopt;
+			}
+			auto s = src_.substr(off, *n);
+			off += *n;
+			return s;
+		}
+
+		// payload length of a container at off, 0 if truncated
+		size_t payload(size_t off) const
+		{
+			if (src_.size() - off < 5) {
+				return 0;
+			}
+			uint32_t len = 0;
+			for (size_t i = 0; i < 4; ++i) {
+				len |= static_cast<uint32_t>(at(off + 1 + i))
+				       << (i * 8);
+			}
+			return len <= src_.size() - off - 5 ? len : 0;
+		}
+
+		// offset just past the value at off, 0 if malformed, O(1) for
+		// containers
+		size_t skip(size_t off) const
+		{
+			switch (at(off)) {
+			case null_tag:
+			case false_tag:
+			case true_tag:
+				return off + 1;
+			case number_tag:
+				return src_.size() - off > 8 ? off + 9 : 0;
+			case integer_tag:
+			case uinteger_tag:
+				++off;
+				return varint(off) ? off : 0;
+			case raw_tag:
+			case string_tag:
+				++off;
+				return bytes(off) ? off : 0;
+			case array_tag:
+			case object_tag: {
+				auto len = payload(off);
+				return len ? off + 5 + len : 0;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		JsonValue decode(size_t &off, size_t depth) const
+		{
+			if (json::detail::too_deep(depth)) {
+				return {};
+			}
+			auto tag = at(off++);
+			switch (tag) {
+			case null_tag:
+				return null_t {};
+			case false_tag:
+			case true_tag:
+				return tag == true_tag;
+			case number_tag: {
+				if (src_.size() - off < 8) {
+					return {};
+				}
+				uint64_t bits = 0;
+				for (size_t i = 0; i < 8; ++i) {
+					uint64_t c = at(off + i);
+					bits |= c << (i * 8);
+				}
+				off += 8;
+				return std::bit_cast<number_t>(bits);
+			}
+			case integer_tag: {
+				auto u = varint(off);
+				if (!u) {
+					return {};
+				}
+				auto z = (*u >> 1) ^ -(*u & 1);
+				return static_cast<int_t>(z);
+			}
+			case uinteger_tag: {
+				auto u = varint(off);
+				return u ? JsonValue { *u } : JsonValue {};
+			}
+			case raw_tag:
+			case string_tag: {
+				auto s = bytes(off);
+				if (!s) {
+					return {};
+				}
+				if (tag == raw_tag) {
+					return raw_t { string_t { *s } };
+				}
+				return string_t { *s };
+			}
+			case array_tag:
+			case object_tag:
+				return container(tag, --off, depth);
+			default:
+				return {};
+			}
+		}
+
+		JsonValue container(uint8_t tag,
+				    size_t &off,
+				    size_t depth) const
+		{
+			auto len = payload(off);
+			auto end = off + 5 + len;
+			off += 5;
+			auto n = varint(off);
+			// every member takes at least one byte
+			if (!len || !n || off > end || *n > end - off) {
+				return {};
+			}
+			if (tag == array_tag) {
+				array_t a;
+				a.reserve(*n);
+				for (uint64_t i = 0; i < *n; ++i) {
+					auto v = decode(off, depth + 1);
+					if (!v || off > end) {
+						return {};
+					}
+					a.push_back(std::move(v));
+				}
+				return off == end ? JsonValue { std::move(a) }
+						  : JsonValue {};
+			}
+			object_t o;
+			o.reserve(*n);
+			for (uint64_t i = 0; i < *n; ++i) {
+				auto k = bytes(off);
+				if (!k) {
+					return {};
+				}
+				auto v = decode(off, depth + 1);
+				if (!v || off > end) {
+					return {};
+				}
+				o.emplace(string_t { *k }, std::move(v));
+			}
+			return off == end ? JsonValue { std::move(o) }
+					  : JsonValue {};
+		}
+	};
+} // namespace detail
+
+// append v to out, which needs append(const char *, size_t), push_back(char),
+// size(), resize() and operator[], false if v is invalid, nested too deeply or
+// has a container over 4GB, out is then left as it was
+template<typename Sink>
+bool encode(const JsonValue &v, Sink &out)
+{
+	auto n = out.size();
+	if (!detail::encode(v, out, 0)) {
+		out.resize(n);
+		return false;
+	}
+	return true;
+}
+// the whole of src must be one value, the result is invalid with a trace if
+// it's malformed, truncated or nested too deeply
+inline JsonValue decode(std::string_view src)
+{
+	detail::Reader r { src };
+	size_t off = 0;
+	auto v = r.decode(off, 0);
+	if (!v || off != src.size()) {
+		return JsonValue::from_trace("malformed binary json, " +
+					     std::to_string(src.size()) +
+					     " bytes");
+	}
+	return v;
+}
+
+// lazy access like ondemand::Value, nothing is decoded but the path walked,
+// siblings are skipped by their length, strings are viewed in the buffer
+// NOTE: the buffer must outlive the Values
+class Value {
+public:
+	class Iterator;
+
+	Value() : r_ {}, pos_ { npos }
+	{
+	}
+
+	// the value at the start of an encoded buffer
+	explicit Value(std::string_view src) : r_ { src }, pos_ { 0 }
+	{
+		if (!r_.skip(0)) {
+			pos_ = npos;
+		}
+	}
+
+	// false if the path that led here does not exist or is malformed
+	explicit operator bool() const
+	{
+		return pos_ != npos;
+	}
+
+	[[nodiscard]] bool is_object() const
+	{
+		return tag() == object_tag;
+	}
+
+	[[nodiscard]] bool is_array() const
+	{
+		return tag() == array_tag;
+	}
+
+	[[nodiscard]] bool is_string() const
+	{
+		return tag() == string_tag;
+	}
+
+	[[nodiscard]] bool is_boolean() const
+	{
+		return tag() == true_tag || tag() == false_tag;
+	}
+
+	[[nodiscard]] bool is_null() const
+	{
+		return tag() == null_tag;
+	}
+
+	[[nodiscard]] bool is_number() const
+	{
+		auto t = tag();
+		return t >= number_tag && t <= raw_tag;
+	}
+
+	// member lookup, invalid if not an object or key is missing
+	inline Value operator[](std::string_view key) const;
+	// element lookup, invalid if not an array or out of range
+	inline Value operator[](size_t i) const;
+
+	std::optional<std::string_view> get_string() const
+	{
+		auto off = pos_ + 1;
+		return is_string() ? r_.bytes(off) : std::nullopt;
+	}
+
+	std::optional<number_t> get_number() const
+	{
+		auto v = is_number() ? decode_this() : JsonValue {};
+		return v ? std::optional { v.to_number() } : std::nullopt;
+	}
+
+	// exact integers, nullopt for doubles or out of range
+	std::optional<int_t> get_int() const
+	{
+		auto v = decode_this();
+		auto i = v.as<int_t>();
+		return i ? std::optional { *i } : std::nullopt;
+	}
+
+	std::optional<uint_t> get_uint() const
+	{
+		auto v = decode_this();
+		if (auto i = v.as<int_t>(); i && *i >= 0) {
+			return static_cast<uint_t>(*i);
+		}
+		auto u = v.as<uint_t>();
+		return u ? std::optional { *u } : std::nullopt;
+	}
+
+	std::optional<bool_t> get_bool() const
+	{
+		if (!is_boolean()) {
+			return std::nullopt;
+		}
+		return tag() == true_tag;
+	}
+
+	// the encoded bytes of this value, tag included
+	std::string_view raw() const
+	{
+		if (pos_ == npos) {
+			return {};
+		}
+		return r_.src_.substr(pos_, r_.skip(pos_) - pos_);
+	}
+
+	// build a JsonValue of this subtree only
+	JsonValue materialize() const
+	{
+		return pos_ == npos ? JsonValue {} : decode(raw());
+	}
+
+	// elements of an array or fields of an object, empty range for
+	// anything else
+	inline Iterator begin() const;
+	inline Iterator end() const;
+
+private:
+	static constexpr size_t npos = SIZE_MAX;
+
+	detail::Reader r_;
+	size_t pos_;
+
+	Value(detail::Reader r, size_t pos) : r_ { r }, pos_ { pos }
+	{
+		if (!r_.skip(pos_)) {
+			pos_ = npos;
+		}
+	}
+
+	uint8_t tag() const
+	{
+		return pos_ == npos ? 0xff : r_.at(pos_);
+	}
+
+	JsonValue decode_this() const
+	{
+		auto off = pos_;
+		return pos_ == npos || is_object() || is_array()
+			       ? JsonValue {}
+			       : r_.decode(off, 0);
+	}
+};
+
+class Value::Iterator {
+	friend class Value;
+
+public:
+	Iterator() : r_ {}, pos_ { npos }, left_ { 0 }, object_ { false }
+	{
+	}
+
+	bool operator==(const Iterator &r) const
+	{
+		return left_ == r.left_;
+	}
+
+	bool operator!=(const Iterator &r) const
+	{
+		return !(*this == r);
+	}
+
+	// a malformed member ends the iteration
+	Iterator &operator++()
+	{
+		auto next = r_.skip(value_pos());
+		pos_ = next ? next : npos;
+		left_ = next ? left_ - 1 : 0;
+		return *this;
+	}
+
+	// for objects the element is the field value, see key()
+	Value operator*() const
+	{
+		return { r_, value_pos() };
+	}
+
+	// key of the current field, empty for arrays
+	std::string_view key() const
+	{
+		auto off = pos_;
+		return object_ ? r_.bytes(off).value_or("") : "";
+	}
+
+private:
+	detail::Reader r_;
+	size_t pos_;
+	uint64_t left_; // members not yet passed
+	bool object_;
+
+	Iterator(detail::Reader r, size_t pos, uint64_t n, bool object)
+		: r_ { r }, pos_ { pos }, left_ { n }, object_ { object }
+	{
+	}
+
+	size_t value_pos() const
+	{
+		auto off = pos_;
+		if (object_ && !r_.bytes(off)) {
+			return npos;
+		}
+		return off;
+	}
+};
+
+Value::Iterator Value::begin() const
+{
+	if (!is_object() && !is_array()) {
+		return end();
+	}
+	auto off = pos_ + 5;
+	auto n = r_.varint(off);
+	return { r_, off, n.value_or(0), is_object() };
+}
+
+Value::Iterator Value::end() const
+{
+	return {};
+}
+
+Value Value::operator[](std::string_view key) const
+{
+	if (!is_object()) {
+		return {};
+	}
+	for (auto it = begin(); it != end(); ++it) {
+		if (it.key() == key) {
+			return *it;
+		}
+	}
+	return {};
+}
+
+Value Value::operator[](size_t i) const
+{
+	if (!is_array()) {
+		return {};
+	}
+	for (auto it = begin(); it != end(); ++it) {
+		if (i-- == 0) {
+			return *it;
+		}
+	}
+	return {};
+}
+
+} // namespace nm::json::binary
+
+#endif // JSON_BINARY_H_
@@ -0,0 +1,330 @@
+/***********************************************
+	File Name: binding.h
+	Author: Abby Cin
+	Mail: abbytsing@gmail.com
+	Created Time: 10/18/26 5:20 PM
+***********************************************/
+
+#ifndef JSON_BINDING_H_
+#define JSON_BINDING_H_
+
+#include "ondemand.h"
+#include <bit>
+#include <limits>
+#include <optional>
+#include <tuple>
+
+// map json straight into structs and back without a JsonValue tree, fields
+// are declared once by specialising Binding:
+//
+//	struct User {
+//		uint64_t id;
+//		std::string name;
+//		std::vector<std::string> tags;
+//	};
+//
+//	template<>
+//	struct nm::json::Binding<User> {
+//		static constexpr auto fields =
+//			std::make_tuple(nm::json::field("id", &User::id),
+//					nm::json::field("name", &User::name),
+//					nm::json::field("tags", &User::tags));
+//	};
+//
+//	auto u = nm::json::read<User>(src);	// std::optional<User>
+//	nm::json::write(*u, buf);		// append to buf
+//
+// members may be bool, arithmetic, std::string, std::optional, std::vector,
+// JsonValue or other bound structs, keys are dispatched by a perfect hash
+// built at compile time, unknown keys are skipped, missing keys leave the
+// member as it was, a value of the wrong type fails the read
+// NOTE: names are written as is, they must not need escaping
+namespace nm::json
+{
+template<typename T>
+struct Binding;
+
+template<typename T, typename M>
+struct FieldOf {
+	std::string_view name;
+	M T::*member;
+};
+
+template<typename T, typename M>
+constexpr FieldOf<T, M> field(std::string_view name, M T::*member)
+{
+	return { name, member };
+}
+
+template<typename T>
+concept bound = requires { Binding<T>::fields; };
+
+namespace detail
+{
+	template<typename T>
+	struct is_optional : std::false_type { };
+	template<typename T>
+	struct is_optional<std::optional<T>> : std::true_type { };
+
+	template<typename T>
+	struct is_vector : std::false_type { };
+	template<typename T, typename A>
+	struct is_vector<std::vector<T, A>> : std::true_type { };
+
+	constexpr uint64_t name_hash(std::string_view s, uint64_t seed)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+		for (auto c : s) {
+			h ^= static_cast<uint8_t>(c);
+			h *= 0x100000001b3ULL;
+		}
+		return h ^ (h >> 29);
+	}
+
+	// seed is searched at compile time until every name lands in its own
+	// slot, a lookup is one hash and one compare
+	template<size_t N>
+	struct PerfectHash {
+		static constexpr size_t size = std::bit_ceil(N * 4 + 1);
+		static constexpr uint16_t none = UINT16_MAX;
+
+		std::array<std::string_view, N> names {};
+		std::array<uint16_t, size> slot {};
+		uint64_t seed = 0;
+
+		constexpr explicit PerfectHash(
+			const std::array<std::string_view, N> &n)
+			: names { n }
+		{
+			while (!build()) {
+				++seed;
+			}
+		}
+
+		// index of k in names, N if not found
+		constexpr size_t find(std::string_view k) const
+		{
+			auto i = slot[name_hash(k, seed) & (size - 1)];
+			return i != none && names[i] == k ? i : N;
+		}
+
+	private:
+		constexpr bool build()
+		{
+			slot.fill(none);
+			for (size_t i = 0; i < N; ++i) {
+				auto &s = slot[name_hash(names[i], seed) &
+					       (size - 1)];
+				if (s != none) {
+					return false;
+				}
+				s = static_cast<uint16_t>(i);
+			}
+			return true;
+		}
+	};
+
+	template<bound T>
+	struct Bound {
+		using Fields =
+			std::remove_cvref_t<decltype(Binding<T>::fields)>;
+		using Names = std::array<std::string_view,
+					 std::tuple_size_v<Fields>>;
+
+		static constexpr auto &fields = Binding<T>::fields;
+		static constexpr size_t N = std::tuple_size_v<Fields>;
+		static_assert(N < PerfectHash<N>::none, "too many fields");
+
+		static constexpr auto hash = std::apply(
+			[](auto &...f) {
+				return PerfectHash<N> { Names { f.name... } };
+			},
+			fields);
+	};
+
+	template<typename T>
+	bool read_value(ondemand::Value v, T &out);
+
+	template<bound T>
+	bool read_object(ondemand::Value v, T &out)
+	{
+		using B = Bound<T>;
+		if (!v.is_object()) {
+			return false;
+		}
+		string_t tmp;
+		auto it = v.begin();
+		for (; it != v.end(); ++it) {
+			auto key = it.key(tmp);
+			if (!key) {
+				return false;
+			}
+			auto i = B::hash.find(*key);
+			if (i == B::N) {
+				continue;
+			}
+			bool ok = true;
+			// jump to the i-th member
+			[&]<size_t... I>(std::index_sequence<I...>) {
+				((i == I &&
+				  (ok = read_value(*it,
+						   out.*std::get<I>(B::fields)
+							   .member),
+				   true)) ||
+				 ...);
+			}(std::make_index_sequence<B::N> {});
+			if (!ok) {
+				return false;
+			}
+		}
+		return it.ok();
+	}
+
+	template<typename T>
+	bool read_number(ondemand::Value v, T &out)
+	{
+		if constexpr (std::is_integral_v<T>) {
+			using L = std::numeric_limits<T>;
+			if constexpr (std::is_signed_v<T>) {
+				auto i = v.get_int();
+				if (!i || *i < L::min() || *i > L::max()) {
+					return false;
+				}
+				out = static_cast<T>(*i);
+			} else {
+				auto u = v.get_uint();
+				if (!u || *u > L::max()) {
+					return false;
+				}
+				out = static_cast<T>(*u);
+			}
+		} else {
+			auto d = v.get_number();
+			if (!d) {
+				return false;
+			}
+			out = static_cast<T>(*d);
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool read_value(ondemand::Value v, T &out)
+	{
+		if constexpr (std::is_same_v<T, bool_t>) {
+			auto b = v.get_bool();
+			if (b) {
+				out = *b;
+			}
+			return b.has_value();
+		} else if constexpr (std::is_arithmetic_v<T>) {
+			return read_number(v, out);
+		} else if constexpr (std::is_same_v<T, string_t>) {
+			auto s = v.get_string();
+			if (s) {
+				out.assign(*s);
+			}
+			return s.has_value();
+		} else if constexpr (std::is_same_v<T, JsonValue>) {
+			out = v.materialize();
+			return static_cast<bool>(out);
+		} else if constexpr (is_optional<T>::value) {
+			if (v.is_null()) {
+				out.reset();
+				return true;
+			}
+			return read_value(v, out.emplace());
+		} else if constexpr (is_vector<T>::value) {
+			if (!v.is_array()) {
+				return false;
+			}
+			out.clear();
+			auto it = v.begin();
+			for (; it != v.end(); ++it) {
+				if (!read_value(*it, out.emplace_back())) {
+					return false;
+				}
+			}
+			return it.ok();
+		} else {
+			return read_object(v, out);
+		}
+	}
+
+	template<typename T, typename Sink>
+	void write_value(const T &v, Sink &out)
+	{
+		if constexpr (std::is_same_v<T, bool_t>) {
+			if (v) {
+				out.append("true", 4);
+			} else {
+				out.append("false", 5);
+			}
+		} else if constexpr (std::is_integral_v<T>) {
+			Writer::integer(out, v);
+		} else if constexpr (std::is_arithmetic_v<T>) {
+			Writer::number(out, static_cast<number_t>(v));
+		} else if constexpr (std::is_same_v<T, string_t>) {
+			Writer::string(out, v);
+		} else if constexpr (std::is_same_v<T, JsonValue>) {
+			if (!v.write(out)) {
+				out.append("null", 4);
+			}
+		} else if constexpr (is_optional<T>::value) {
+			if (v) {
+				write_value(*v, out);
+			} else {
+				out.append("null", 4);
+			}
+		} else if constexpr (is_vector<T>::value) {
+			out.push_back('[');
+			for (size_t i = 0; i < v.size(); ++i) {
+				if (i) {
+					out.push_back(',');
+				}
+				write_value(v[i], out);
+			}
+			out.push_back(']');
+		} else {
+			static_assert(bound<T>, "type is not bound");
+			out.push_back('{');
+			std::apply(
+				[&](auto &...f) {
+					bool first = true;
+					((out.append(first ? "\"" : ",\"",
+						     first ? 1 : 2),
+					  first = false,
+					  out.append(f.name.data(),
+						     f.name.size()),
+					  out.append("\":", 2),
+					  write_value(v.*f.member, out)),
+					 ...);
+				},
+				Binding<T>::fields);
+			out.push_back('}');
+		}
+	}
+} // namespace detail
+
+// parse src into a T, nullopt if src is malformed along the path that is
+// read or a value has the wrong type
+template<bound T>
+std::optional<T> read(std::string_view src)
+{
+	ondemand::Document doc { src };
+	T out {};
+	if (!doc || !detail::read_object(doc.root(), out)) {
+		return std::nullopt;
+	}
+	return out;
+}
+
+// append obj as compact json to a sink, see detail::Writer
+template<bound T, typename Sink>
+void write(const T &obj, Sink &out)
+{
+	detail::write_value(obj, out);
+}
+} // namespace nm::json
+
+#endif // JSON_BINDING_H_
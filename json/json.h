@@ -8,11 +8,20 @@
 #ifndef JSON_H_
 #define JSON_H_
 
+#include <swisstable/swiss_map.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
 #include <iomanip>
-#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 #ifndef NDEBUG
@@ -38,16 +47,41 @@ struct debugger {
 namespace nm::json
 {
 class JsonValue;
+namespace detail
+{
+	template<typename V>
+	class Object;
+}
 struct null_t { };
 using number_t = double;
+using int_t = int64_t;
+using uint_t = uint64_t;
+// number kept as its source text, for lossless passthrough
+struct raw_t {
+	std::string text;
+};
 using bool_t = bool;
 using string_t = std::string;
 using array_t = std::vector<JsonValue>;
-using object_t = std::map<std::string, JsonValue>;
+using object_t = detail::Object<JsonValue>;
+// a value may sit inside at most max_depth arrays and objects, the parser,
+// the writer, StreamParser and the binary codec all count it the same way
 inline constexpr size_t max_depth = 50;
 
+struct ParseOptions {
+	// keep every number as raw_t with its source text, so it's written
+	// back exactly as read
+	bool raw_numbers = false;
+};
+
 namespace detail
 {
+	// depth is the number of containers around a value
+	inline constexpr bool too_deep(size_t depth)
+	{
+		return depth > max_depth;
+	}
+
 	template<typename T>
 	struct nullable {
 		nullable() : ok { false }, ch {}
@@ -83,27 +117,242 @@ namespace detail
 		T ch;
 	};
 
+	// members are kept flat in insertion order, small objects are searched
+	// linearly, from k_index members on a SwissMap from key to position
+	// is built aside, it views the keys in items_ and is rebuilt whenever
+	// items_ reallocates
+	// NOTE: keys must not be modified through iterators
+	template<typename V>
+	class Object {
+	public:
+		using key_type = string_t;
+		using mapped_type = V;
+		using value_type = std::pair<string_t, V>;
+		using iterator = typename std::vector<value_type>::iterator;
+		using const_iterator =
+			typename std::vector<value_type>::const_iterator;
+
+		static constexpr size_t k_index = 16;
+
+		Object() = default;
+
+		Object(std::initializer_list<value_type> il)
+		{
+			items_.reserve(il.size());
+			for (auto &x : il) {
+				emplace(x.first, x.second);
+			}
+		}
+
+		Object(const Object &r) : items_ { r.items_ }
+		{
+			reindex();
+		}
+
+		Object(Object &&) noexcept = default;
+
+		Object &operator=(const Object &r)
+		{
+			if (this != &r) {
+				Object tmp { r };
+				*this = std::move(tmp);
+			}
+			return *this;
+		}
+
+		Object &operator=(Object &&) noexcept = default;
+
+		size_t size() const
+		{
+			return items_.size();
+		}
+
+		bool empty() const
+		{
+			return items_.empty();
+		}
+
+		iterator begin()
+		{
+			return items_.begin();
+		}
+
+		iterator end()
+		{
+			return items_.end();
+		}
+
+		const_iterator begin() const
+		{
+			return items_.begin();
+		}
+
+		const_iterator end() const
+		{
+			return items_.end();
+		}
+
+		iterator find(std::string_view k)
+		{
+			return items_.begin() + position(k);
+		}
+
+		const_iterator find(std::string_view k) const
+		{
+			return items_.begin() + position(k);
+		}
+
+		bool contains(std::string_view k) const
+		{
+			return position(k) != items_.size();
+		}
+
+		// no-op if k exists, the same as std::map
+		template<typename K, typename... Args>
+		std::pair<iterator, bool> emplace(K &&k, Args &&...args)
+		{
+			auto it = find(k);
+			if (it != end()) {
+				return { it, false };
+			}
+			push(std::forward<K>(k), std::forward<Args>(args)...);
+			return { end() - 1, true };
+		}
+
+		template<typename K>
+		std::pair<iterator, bool> insert_or_assign(K &&k, V &&v)
+		{
+			auto [it, ok] = emplace(std::forward<K>(k));
+			it->second = std::move(v);
+			return { it, ok };
+		}
+
+		V &operator[](std::string_view k)
+		{
+			return emplace(k).first->second;
+		}
+
+		// keeps the order of the rest, O(n)
+		size_t erase(std::string_view k)
+		{
+			auto it = find(k);
+			if (it == end()) {
+				return 0;
+			}
+			items_.erase(it);
+			reindex();
+			return 1;
+		}
+
+		void reserve(size_t n)
+		{
+			auto cap = items_.capacity();
+			items_.reserve(n);
+			if (items_.capacity() != cap) {
+				reindex();
+			}
+		}
+
+		void clear()
+		{
+			items_.clear();
+			index_.reset();
+		}
+
+	private:
+		using Index = SwissMap<std::string_view, uint32_t>;
+
+		std::vector<value_type> items_ {};
+		std::unique_ptr<Index> index_ {};
+
+		size_t position(std::string_view k) const
+		{
+			if (index_) {
+				auto it = index_->find(k);
+				return it == index_->end() ? items_.size()
+							   : it->second;
+			}
+			// sizes are compared first
+			for (size_t i = 0; i < items_.size(); ++i) {
+				if (std::string_view { items_[i].first } == k) {
+					return i;
+				}
+			}
+			return items_.size();
+		}
+
+		template<typename K, typename... Args>
+		void push(K &&k, Args &&...args)
+		{
+			auto cap = items_.capacity();
+			items_.emplace_back(
+				std::piecewise_construct,
+				std::forward_as_tuple(std::forward<K>(k)),
+				std::forward_as_tuple(
+					std::forward<Args>(args)...));
+			// short keys live inside items_, a reallocation
+			// moves them
+			if (items_.capacity() != cap ||
+			    items_.size() == k_index) {
+				reindex();
+			} else if (index_) {
+				index_->emplace(std::string_view {
+							items_.back().first },
+						items_.size() - 1);
+			}
+		}
+
+		void reindex()
+		{
+			if (items_.size() < k_index) {
+				index_.reset();
+				return;
+			}
+			if (!index_) {
+				index_ = std::make_unique<Index>();
+			}
+			index_->clear();
+			index_->reserve(items_.size());
+			for (size_t i = 0; i < items_.size(); ++i) {
+				index_->emplace(
+					std::string_view { items_[i].first },
+					i);
+			}
+		}
+	};
+
+	// 16 bytes tagged value, scalars are stored inline, strings and
+	// containers are owned through a single pointer, an invalid value
+	// carries the error trace of the parse that produced it, if any
 	struct value_type {
 		value_type() : data { null_t {} }, type { invalid }
 		{
+			data.trace_ = nullptr;
 		}
 
-		enum Category {
+		enum Category : uint8_t {
 			null = 0,
 			invalid,
 			boolean,
 			number,
 			array,
 			string,
-			object
+			object,
+			integer,  // int_t
+			uinteger, // uint_t above INT64_MAX
+			raw
 		};
 		union Data {
 			null_t null_;
 			bool_t bool_;
 			number_t number_;
+			int_t int_;
+			uint_t uint_;
+			raw_t *raw_;
 			array_t *array_;
 			string_t *string_;
 			object_t *object_;
+			string_t *trace_;
 		};
 
 		Data data;
@@ -126,6 +375,20 @@ namespace detail
 		static constexpr value_type::Category type = value_type::number;
 	};
 	template<>
+	struct type_map<int_t> {
+		static constexpr value_type::Category type =
+			value_type::integer;
+	};
+	template<>
+	struct type_map<uint_t> {
+		static constexpr value_type::Category type =
+			value_type::uinteger;
+	};
+	template<>
+	struct type_map<raw_t> {
+		static constexpr value_type::Category type = value_type::raw;
+	};
+	template<>
 	struct type_map<array_t> {
 		static constexpr value_type::Category type = value_type::array;
 	};
@@ -162,6 +425,27 @@ namespace detail
 		}
 	};
 	template<>
+	struct value_map<int_t> {
+		static constexpr int_t *value(value_type::Data &v)
+		{
+			return &v.int_;
+		}
+	};
+	template<>
+	struct value_map<uint_t> {
+		static constexpr uint_t *value(value_type::Data &v)
+		{
+			return &v.uint_;
+		}
+	};
+	template<>
+	struct value_map<raw_t> {
+		static constexpr raw_t *value(value_type::Data &v)
+		{
+			return v.raw_;
+		}
+	};
+	template<>
 	struct value_map<array_t> {
 		static constexpr array_t *value(value_type::Data &v)
 		{
@@ -184,175 +468,365 @@ namespace detail
 	};
 } // namespace detail
 
-class JsonValue final {
-	using value_type = detail::value_type;
-	static void deleter(value_type *v)
-	{
-		switch (v->type) {
-		case value_type::string: {
-			delete v->data.string_;
-			break;
+namespace detail
+{
+	// output primitives shared by JsonValue and the struct binding, a sink
+	// is anything with append(const char *, size_t) and push_back(char)
+	struct Writer {
+		// shortest text that reads back to the same double, JSON has no
+		// NaN nor Inf, they are written as null
+		template<typename Sink>
+		static void number(Sink &out, number_t d)
+		{
+			char buf[32];
+			if (d != d || d - d != 0) {
+				out.append("null", 4);
+				return;
+			}
+			auto r = std::to_chars(buf, buf + sizeof(buf), d);
+			out.append(buf, r.ptr - buf);
 		}
-		case value_type::object: {
-			delete v->data.object_;
-			break;
+
+		template<typename Sink, std::integral T>
+		static void integer(Sink &out, T v)
+		{
+			char buf[24];
+			auto r = std::to_chars(buf, buf + sizeof(buf), v);
+			out.append(buf, r.ptr - buf);
 		}
-		case value_type::array: {
-			delete v->data.array_;
-			break;
+
+		template<typename Sink>
+		static void space(Sink &out, size_t n, bool compact)
+		{
+			static const std::string spaces(32, ' ');
+			const size_t k = spaces.size();
+			if (compact) {
+				return;
+			}
+			for (; n > k; n -= k) {
+				out.append(spaces.data(), k);
+			}
+			out.append(spaces.data(), n);
 		}
-		default:
-			break;
+
+		template<typename Sink>
+		static void new_line(Sink &out, bool compact)
+		{
+			if (!compact) {
+				out.push_back('\n');
+			}
 		}
-		delete v;
-	}
+
+		// escape of every byte, 0 means as is, 'u' means \u00XX
+		static const char *table()
+		{
+			static const auto table = [] {
+				std::array<char, 256> t {};
+				for (int c = 0; c < 0x20; ++c) {
+					t[c] = 'u';
+				}
+				t['"'] = '"';
+				t['\\'] = '\\';
+				t['\b'] = 'b';
+				t['\f'] = 'f';
+				t['\n'] = 'n';
+				t['\r'] = 'r';
+				t['\t'] = 't';
+				return t;
+			}();
+			return table.data();
+		}
+
+		// index of the first byte in [i, n) to escape, n if none
+		static size_t find_escape(const char *p, size_t i, size_t n)
+		{
+			auto q = _mm_set1_epi8('"');
+			auto bs = _mm_set1_epi8('\\');
+			auto ctl = _mm_set1_epi8(0x1f);
+			for (; i + 16 <= n; i += 16) {
+				auto v = _mm_loadu_si128(
+					reinterpret_cast<const __m128i *>(p +
+									  i));
+				auto lo = _mm_max_epu8(v, ctl);
+				auto m = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(v, q),
+						     _mm_cmpeq_epi8(v, bs)),
+					_mm_cmpeq_epi8(lo, ctl));
+				if (auto bits = _mm_movemask_epi8(m)) {
+					return i + __builtin_ctz(bits);
+				}
+			}
+			auto t = table();
+			while (i < n && !t[static_cast<uint8_t>(p[i])]) {
+				++i;
+			}
+			return i;
+		}
+
+		// runs without special characters are appended in bulk
+		template<typename Sink>
+		static void string(Sink &out, std::string_view s)
+		{
+			static const char hex[] = "0123456789abcdef";
+			auto t = table();
+			size_t i = 0;
+			out.push_back('"');
+			while (true) {
+				auto e = find_escape(s.data(), i, s.size());
+				out.append(s.data() + i, e - i);
+				if (e == s.size()) {
+					break;
+				}
+				auto c = static_cast<uint8_t>(s[e]);
+				char esc[6] = { '\\', t[c] };
+				size_t len = 2;
+				if (t[c] == 'u') {
+					esc[2] = '0';
+					esc[3] = '0';
+					esc[4] = hex[c >> 4];
+					esc[5] = hex[c & 0xf];
+					len = 6;
+				}
+				out.append(esc, len);
+				i = e + 1;
+			}
+			out.push_back('"');
+		}
+	};
+} // namespace detail
+
+class JsonValue final {
+	using value_type = detail::value_type;
 
 public:
-	JsonValue() : value_ { new value_type {}, deleter }, trace_ {}
+	JsonValue() : value_ {}
 	{
 	}
 	template<size_t N>
-	JsonValue(const char (&a)[N]) : JsonValue { string_t { a, N } }
+	JsonValue(const char (&a)[N]) : JsonValue { string_t { a, N - 1 } }
 	{
 	}
 	// no explicit
 	JsonValue(string_t &&s) : JsonValue {}
 	{
-		value_->data.string_ = new std::string { std::move(s) };
-		value_->type = value_type::string;
+		value_.data.string_ = new std::string { std::move(s) };
+		value_.type = value_type::string;
 	}
 	JsonValue(number_t d) : JsonValue {}
 	{
-		value_->data.number_ = d;
-		value_->type = value_type::number;
+		value_.data.number_ = d;
+		value_.type = value_type::number;
+	}
+	// int_t for signed, uint_t for unsigned above INT64_MAX
+	template<std::integral T>
+		requires(!std::is_same_v<T, bool_t>)
+	JsonValue(T v) : JsonValue {}
+	{
+		if (std::is_signed_v<T> ||
+		    static_cast<uint_t>(v) <= INT64_MAX) {
+			value_.data.int_ = static_cast<int_t>(v);
+			value_.type = value_type::integer;
+		} else {
+			value_.data.uint_ = static_cast<uint_t>(v);
+			value_.type = value_type::uinteger;
+		}
+	}
+	JsonValue(raw_t &&r) : JsonValue {}
+	{
+		value_.data.raw_ = new raw_t { std::move(r) };
+		value_.type = value_type::raw;
 	}
 	JsonValue(null_t n) : JsonValue {}
 	{
-		value_->data.null_ = n;
-		value_->type = value_type::null;
+		value_.data.null_ = n;
+		value_.type = value_type::null;
 	}
 	JsonValue(bool_t b) : JsonValue {}
 	{
-		value_->data.bool_ = b;
-		value_->type = value_type::boolean;
+		value_.data.bool_ = b;
+		value_.type = value_type::boolean;
 	}
 	JsonValue(array_t &&a) : JsonValue {}
 	{
 #if 1
-		value_->data.array_ = new array_t {};
-		*value_->data.array_ = std::move(a);
+		value_.data.array_ = new array_t {};
+		*value_.data.array_ = std::move(a);
 #else
 		// recursively call itself when using g++ (clang++ is ok)
-		value_->data.array_ = new array_t { std::move(a) };
+		value_.data.array_ = new array_t { std::move(a) };
 #endif
-		value_->type = value_type::array;
+		value_.type = value_type::array;
 	}
 	JsonValue(object_t &&o) : JsonValue {}
 	{
-		value_->data.object_ = new object_t { std::move(o) };
-		value_->type = value_type::object;
+		value_.data.object_ = new object_t { std::move(o) };
+		value_.type = value_type::object;
 	}
 
-	JsonValue(JsonValue &&r) noexcept
-		: value_ { std::move(r.value_) }, trace_ { std::move(r.trace_) }
+	JsonValue(JsonValue &&r) noexcept : value_ { r.value_ }
 	{
+		r.value_ = {};
 	}
 
 	JsonValue &operator=(JsonValue &&r) noexcept
 	{
-		if (this != &r) {
-			value_ = std::move(r.value_);
-			trace_ = std::move(r.trace_);
-		}
+		// r may live inside this, e.g. v = std::move(v["data"]), so
+		// take it out before releasing what holds it
+		auto v = r.value_;
+		r.value_ = {};
+		release();
+		value_ = v;
 		return *this;
 	}
 
-	JsonValue(const JsonValue &r) : value_ { r.value_ }, trace_ { r.trace_ }
+	// deep copy, values own their children
+	JsonValue(const JsonValue &r) : JsonValue {}
 	{
+		copy(r);
 	}
 
 	JsonValue &operator=(const JsonValue &r)
 	{
 		if (this != &r) {
-			value_ = r.value_;
-			trace_ = r.trace_;
+			JsonValue tmp { r };
+			*this = std::move(tmp);
 		}
 		return *this;
 	}
 
-	~JsonValue() = default;
+	~JsonValue()
+	{
+		release();
+	}
 
 	[[nodiscard]] const std::string &trace() const
 	{
-		return trace_;
+		static const std::string empty {};
+		if (value_.type != value_type::invalid || !value_.data.trace_) {
+			return empty;
+		}
+		return *value_.data.trace_;
 	}
 	static JsonValue from_trace(const std::string &t)
 	{
 		JsonValue res {};
-		res.trace_ = t;
+		res.value_.data.trace_ = new std::string { t };
 		return res;
 	}
 
 	[[nodiscard]] bool is_boolean() const
 	{
-		return value_->type == value_type::boolean;
+		return value_.type == value_type::boolean;
 	}
 
 	[[nodiscard]] bool is_null() const
 	{
-		return value_->type == value_type::null;
+		return value_.type == value_type::null;
 	}
 
+	// any of number_t, int_t, uint_t or raw_t
 	[[nodiscard]] bool is_number() const
 	{
-		return value_->type == value_type::number;
+		switch (value_.type) {
+		case value_type::number:
+		case value_type::integer:
+		case value_type::uinteger:
+		case value_type::raw:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	[[nodiscard]] bool is_integer() const
+	{
+		return value_.type == value_type::integer ||
+		       value_.type == value_type::uinteger;
+	}
+
+	// numeric value as a double whatever it is stored as, 0 if it's not
+	// a number
+	[[nodiscard]] number_t to_number() const
+	{
+		switch (value_.type) {
+		case value_type::number:
+			return value_.data.number_;
+		case value_type::integer:
+			return static_cast<number_t>(value_.data.int_);
+		case value_type::uinteger:
+			return static_cast<number_t>(value_.data.uint_);
+		case value_type::raw: {
+			number_t d = 0;
+			auto &t = value_.data.raw_->text;
+			std::from_chars(t.data(), t.data() + t.size(), d);
+			return d;
+		}
+		default:
+			return 0;
+		}
 	}
 
 	[[nodiscard]] bool is_string() const
 	{
-		return value_->type == value_type::string;
+		return value_.type == value_type::string;
 	}
 
 	[[nodiscard]] bool is_array() const
 	{
-		return value_->type == value_type::array;
+		return value_.type == value_type::array;
 	}
 
 	[[nodiscard]] bool is_object() const
 	{
-		return value_->type == value_type::object;
+		return value_.type == value_type::object;
 	}
 
 	explicit operator bool() const
 	{
-		return value_->type != value_type::invalid;
+		return value_.type != value_type::invalid;
 	}
 
+	// nullptr unless stored as T, a number may be any of number_t, int_t,
+	// uint_t and raw_t, to_number() reads all of them
 	template<typename T>
 	T *as()
 	{
 		auto type = detail::type_map<T>::type;
-		if (value_->type != type || type == value_type::invalid) {
+		if (value_.type != type || type == value_type::invalid) {
 			return nullptr;
 		}
-		return detail::value_map<T>::value(value_->data);
+		return detail::value_map<T>::value(value_.data);
 	}
 
-	// no check
+	template<typename T>
+	const T *as() const
+	{
+		return const_cast<JsonValue *>(this)->as<T>();
+	}
+
+	// the type must match, checked only by assert, except get<number_t>()
+	// which takes any number, an int_t, uint_t or raw_t is turned into a
+	// double in place, as all numbers were before they were kept exact
 	template<typename T>
 	T &get()
 	{
-		return *detail::value_map<T>::value(value_->data);
+		if constexpr (std::is_same_v<T, number_t>) {
+			if (is_number() && value_.type != value_type::number) {
+				*this = to_number();
+			}
+		}
+		assert(value_.type == detail::type_map<T>::type);
+		return *detail::value_map<T>::value(value_.data);
 	}
 
 	JsonValue &operator[](size_t i)
 	{
-		return (*value_->data.array_)[i];
+		return (*value_.data.array_)[i];
 	}
 
 	JsonValue &operator[](const string_t &k)
 	{
-		return (*value_->data.object_)[k];
+		return (*value_.data.object_)[k];
 	}
 
 	std::string to_string(bool *ok = nullptr) const
@@ -365,159 +839,192 @@ public:
 		return to_string(false, indent, ok);
 	}
 
+	// append to a reusable buffer or any sink with append(const char *,
+	// size_t) and push_back(char), false if invalid or nested too deeply
+	template<typename Sink>
+	bool write(Sink &out) const
+	{
+		return *this && write_impl(out, 0, 0, 0, true);
+	}
+
+	template<typename Sink>
+	bool write(Sink &out, size_t indent) const
+	{
+		return *this && write_impl(out, indent, indent, 0, false);
+	}
+
 private:
-	std::shared_ptr<value_type> value_;
-	std::string trace_;
+	value_type value_;
+
+	void release()
+	{
+		switch (value_.type) {
+		case value_type::string:
+			delete value_.data.string_;
+			break;
+		case value_type::object:
+			delete value_.data.object_;
+			break;
+		case value_type::array:
+			delete value_.data.array_;
+			break;
+		case value_type::raw:
+			delete value_.data.raw_;
+			break;
+		case value_type::invalid:
+			delete value_.data.trace_;
+			break;
+		default:
+			break;
+		}
+		value_ = {};
+	}
+
+	void copy(const JsonValue &r)
+	{
+		value_.type = r.value_.type;
+		switch (r.value_.type) {
+		case value_type::string:
+			value_.data.string_ =
+				new string_t(*r.value_.data.string_);
+			break;
+		case value_type::object:
+			value_.data.object_ =
+				new object_t(*r.value_.data.object_);
+			break;
+		case value_type::array:
+			value_.data.array_ = new array_t {};
+			*value_.data.array_ = *r.value_.data.array_;
+			break;
+		case value_type::raw:
+			value_.data.raw_ = new raw_t { *r.value_.data.raw_ };
+			break;
+		case value_type::invalid:
+			if (r.value_.data.trace_) {
+				value_.data.trace_ =
+					new string_t { *r.value_.data.trace_ };
+			}
+			break;
+		default:
+			value_.data = r.value_.data;
+			break;
+		}
+	}
 
 	std::string to_string(bool compact, size_t indent, bool *ok) const
 	{
+		std::string out;
 		if (!(bool)*this) {
-			if (ok) {
-				*ok = false;
-			}
-			return "invalid JsonValue";
+			out = "invalid JsonValue";
+		} else if (!write_impl(out, indent, indent, 0, compact)) {
+			out = "nested too deeply, nest depth is limited to " +
+			      std::to_string(max_depth);
+		} else {
+			return out;
 		}
-		size_t depth = 0;
-		std::ostringstream os;
-		os << std::fixed << std::setprecision(20) << std::boolalpha;
-		to_string_impl(os, indent, indent, true, depth, compact);
-		if (depth > max_depth) {
-			if (ok) {
-				*ok = false;
-			}
-			return "nested too deeply, nest depth is limited to " +
-				std::to_string(max_depth);
+		if (ok) {
+			*ok = false;
 		}
-		return os.str();
+		return out;
 	}
 
-	void to_string_impl(std::ostringstream &os,
-			    size_t indent,
-			    size_t cur_indent,
-			    bool top,
-			    size_t &depth,
-			    bool compact) const
+	template<typename Sink>
+	bool write_impl(Sink &out,
+			size_t indent,
+			size_t cur_indent,
+			size_t depth,
+			bool compact) const
 	{
-		switch (value_->type) {
+		using W = detail::Writer;
+		if (detail::too_deep(depth)) {
+			return false;
+		}
+		switch (value_.type) {
 		case value_type::null:
-			os << "null";
+			out.append("null", 4);
 			break;
 		case value_type::invalid:
-			os << "";
 			break;
 		case value_type::boolean:
-			os << value_->data.bool_;
-			break;
-		case value_type::number: {
-			auto s = std::to_string(value_->data.number_);
-			s = s.substr(0, s.find_last_not_of('0') + 1);
-			if (!s.empty() && s.back() == '.') {
-				s.pop_back();
+			if (value_.data.bool_) {
+				out.append("true", 4);
+			} else {
+				out.append("false", 5);
 			}
-			os << s;
 			break;
-		}
+		case value_type::number:
+			W::number(out, value_.data.number_);
+			break;
+		case value_type::integer:
+			W::integer(out, value_.data.int_);
+			break;
+		case value_type::uinteger:
+			W::integer(out, value_.data.uint_);
+			break;
+		case value_type::raw:
+			out.append(value_.data.raw_->text.data(),
+				   value_.data.raw_->text.size());
+			break;
+		case value_type::string:
+			W::string(out, *value_.data.string_);
+			break;
 		case value_type::array: {
-			if (depth > max_depth) {
-				return;
-			}
-			++depth;
-			os << '[';
-			new_line(os, compact);
-			size_t n = value_->data.array_->size();
-			size_t idx = 0;
-			for (auto &v : *value_->data.array_) {
-				make_space(cur_indent, os, compact);
-				v.to_string_impl(os,
-						 indent,
-						 cur_indent + indent,
-						 false,
-						 depth,
-						 compact);
-				if (idx < n - 1) {
-					os << ',';
+			auto &a = *value_.data.array_;
+			out.push_back('[');
+			W::new_line(out, compact);
+			for (size_t i = 0; i < a.size(); ++i) {
+				W::space(out, cur_indent, compact);
+				if (!a[i].write_impl(out,
+						     indent,
+						     cur_indent + indent,
+						     depth + 1,
+						     compact)) {
+					return false;
 				}
-				new_line(os, compact);
-				idx += 1;
-			}
-			if (!top) {
-				make_space(cur_indent - indent, os, compact);
+				if (i + 1 < a.size()) {
+					out.push_back(',');
+				}
+				W::new_line(out, compact);
 			}
-			os << ']';
-			--depth;
-			break;
-		}
-		case value_type::string: {
-			escape_str(os, *value_->data.string_);
+			W::space(out, cur_indent - indent, compact);
+			out.push_back(']');
 			break;
 		}
 		case value_type::object: {
-			if (depth > max_depth) {
-				return;
-			}
-			++depth;
 			size_t idx = 0;
-			size_t size = value_->data.object_->size();
-			os << '{';
-			new_line(os, compact);
-			for (auto &[k, v] : *value_->data.object_) {
-				make_space(cur_indent, os, compact);
-				escape_str(os, k);
-				os << ':';
+			size_t size = value_.data.object_->size();
+			out.push_back('{');
+			W::new_line(out, compact);
+			for (auto &[k, v] : *value_.data.object_) {
+				W::space(out, cur_indent, compact);
+				W::string(out, k);
+				out.push_back(':');
 				if (!compact) {
-					os << ' ';
+					out.push_back(' ');
 				}
-				v.to_string_impl(os,
-						 indent,
-						 cur_indent + indent,
-						 false,
-						 depth,
-						 compact);
-				if (idx < size - 1) {
-					os << ',';
+				if (!v.write_impl(out,
+						  indent,
+						  cur_indent + indent,
+						  depth + 1,
+						  compact)) {
+					return false;
 				}
-				new_line(os, compact);
-				idx += 1;
-			}
-			if (!top) {
-				make_space(cur_indent - indent, os, compact);
+				if (++idx < size) {
+					out.push_back(',');
+				}
+				W::new_line(out, compact);
 			}
-			os << '}';
-			--depth;
+			W::space(out, cur_indent - indent, compact);
+			out.push_back('}');
 			break;
 		}
 		}
-	}
-
-	static void make_space(size_t n, std::ostringstream &os, bool compact)
-	{
-		if (!compact) {
-			while (n-- > 0) {
-				os << ' ';
-			}
-		}
-	}
-
-	static void new_line(std::ostringstream &os, bool compact)
-	{
-		if (!compact) {
-			os << '\n';
-		}
-	}
-
-	static void escape_str(std::ostringstream &os, const std::string &s)
-	{
-		os << '"';
-		for (auto c : s) {
-			if (c == '"' || c == '\\') {
-				os << '\\';
-			}
-			os << c;
-		}
-		os << '"';
+		return true;
 	}
 };
 
+static_assert(sizeof(JsonValue) == 16);
+
 inline std::ostream &operator<<(std::ostream &os, const JsonValue &j)
 {
 	os << j.to_string();
@@ -527,436 +1034,585 @@ inline std::ostream &operator<<(std::ostream &os, const JsonValue &j)
 namespace detail
 {
 	using namespace json;
-	enum Token {
-		Comma = 0,
-		Colon,
-		BracketOn,
-		BracketOff,
-		BraceOn,
-		BraceOff,
-		String,
-		Number,
-		BooleanTrue,
-		BooleanFalse,
-		Null,
-		Invalid
+
+	// stage 1: scan the input 64 bytes a time with SSE2 and record the
+	// offset of every structural character ({}[]:,), every opening
+	// quote and the first byte of every scalar (number, true, false,
+	// null), characters inside strings are masked out, this is the
+	// algorithm of simdjson
+	class Indexer {
+	public:
+		// return false if a string is not closed or input is too large
+		static bool index(std::string_view src,
+				  std::vector<uint32_t> &idx)
+		{
+			if (src.size() >= UINT32_MAX) {
+				return false;
+			}
+			Indexer s {};
+			idx.clear();
+			idx.reserve(src.size() / 8 + 16);
+			size_t i = 0;
+			for (; i + 64 <= src.size(); i += 64) {
+				s.step(src.data() + i, i, idx);
+			}
+			if (i < src.size()) {
+				char tail[64];
+				std::memset(tail, ' ', sizeof(tail));
+				std::memcpy(tail,
+					    src.data() + i,
+					    src.size() - i);
+				s.step(tail, i, idx);
+			}
+			return s.in_string_ == 0;
+		}
+
+	private:
+		uint64_t escaped_ = 0;
+		uint64_t in_string_ = 0;
+		uint64_t scalar_ = 0;
+
+		static uint64_t eq(const __m128i (&v)[4], char c)
+		{
+			auto p = _mm_set1_epi8(c);
+			uint64_t r = 0;
+			for (int i = 0; i < 4; ++i) {
+				auto m = _mm_movemask_epi8(
+					_mm_cmpeq_epi8(v[i], p));
+				r |= static_cast<uint64_t>(m) << (i * 16);
+			}
+			return r;
+		}
+
+		static uint64_t prefix_xor(uint64_t x)
+		{
+			x ^= x << 1;
+			x ^= x << 2;
+			x ^= x << 4;
+			x ^= x << 8;
+			x ^= x << 16;
+			x ^= x << 32;
+			return x;
+		}
+
+		// characters preceded by an odd number of backslashes
+		uint64_t find_escaped(uint64_t backslash)
+		{
+			const uint64_t even = 0x5555555555555555ULL;
+			backslash &= ~escaped_;
+			uint64_t follows = backslash << 1 | escaped_;
+			uint64_t odd_starts = backslash & ~even & ~follows;
+			uint64_t even_seq;
+			escaped_ = __builtin_add_overflow(
+				odd_starts, backslash, &even_seq);
+			return (even ^ (even_seq << 1)) & follows;
+		}
+
+		void
+		step(const char *p, size_t base, std::vector<uint32_t> &idx)
+		{
+			__m128i v[4];
+			for (int i = 0; i < 4; ++i) {
+				v[i] = _mm_loadu_si128(
+					reinterpret_cast<const __m128i *>(p) +
+					i);
+			}
+			uint64_t escaped = find_escaped(eq(v, '\\'));
+			uint64_t quote = eq(v, '"') & ~escaped;
+			uint64_t in_string = prefix_xor(quote) ^ in_string_;
+			in_string_ = static_cast<uint64_t>(
+				static_cast<int64_t>(in_string) >> 63);
+
+			uint64_t op = eq(v, '{') | eq(v, '}') | eq(v, '[') |
+				      eq(v, ']') | eq(v, ':') | eq(v, ',');
+			uint64_t ws = eq(v, ' ') | eq(v, '\t') | eq(v, '\n') |
+				      eq(v, '\r');
+			op &= ~in_string;
+			uint64_t scalar = ~(op | ws | quote | in_string);
+			uint64_t starts = scalar & ~(scalar << 1 | scalar_);
+			scalar_ = scalar >> 63;
+
+			uint64_t bits = op | (quote & in_string) | starts;
+			while (bits) {
+				idx.push_back(base + __builtin_ctzll(bits));
+				bits &= bits - 1;
+			}
+		}
 	};
 
-	class Tokenizer {
+	// helpers shared by the DOM parser and the on-demand cursor, offsets
+	// are byte offsets into src_
+	class Scanner {
 	public:
-		explicit Tokenizer(const std::string &src)
-			: idx_next_ { 0 }, line_ { 0 }, src_ { src }
+		explicit Scanner(std::string_view src) : src_ { src }
 		{
 		}
-		~Tokenizer() = default;
 
-		nullable<Token> next()
+		std::string_view src_;
+
+		char at(size_t off) const
 		{
-			while (true) {
-				auto iter = next_ch();
-				if (!iter) {
-					break;
-				}
-				switch (*iter) {
-				case ',': {
-					return Token::Comma;
-				}
-				case ':':
-					return Token::Colon;
-				case '[':
-					return Token::BracketOn;
-				case ']':
-					return Token::BracketOff;
-				case '{':
-					return Token::BraceOn;
-				case '}':
-					return Token::BraceOff;
-				case '-':
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-					return Token::Number;
-				case '"':
-					return Token::String;
-				case 'a':
-				case 'e':
-				case 'f':
-				case 'l':
-				case 'n':
-				case 'r':
-				case 's':
-				case 't':
-				case 'u': {
-					auto sym = this->read_symbol(*iter);
-					if (!sym) {
-						return Token::Invalid;
-					}
-					if (*sym == "true") {
-						return Token::BooleanTrue;
-					} else if (*sym == "false") {
-						return Token::BooleanFalse;
-					} else if (*sym == "null") {
-						return Token::Null;
-					} else {
-						return Token::Invalid;
-					}
-				}
-				default: {
-					if (::isspace(*iter)) {
-						if (*iter == '\n') {
-							line_ += 1;
-						}
-						continue;
-					}
-					return Token::Invalid;
+			return off < src_.size() ? src_[off] : '\0';
+		}
+
+		static bool is_delim(char c)
+		{
+			switch (c) {
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+			case ',':
+			case ':':
+			case '[':
+			case ']':
+			case '{':
+			case '}':
+			case '"':
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		size_t scalar_end(size_t off) const
+		{
+			while (off < src_.size() && !is_delim(src_[off])) {
+				++off;
+			}
+			return off;
+		}
+
+		// first '"' or '\\' at or after off, the string is known
+		// to be closed by stage 1
+		// first '"' or '\\' at or after off, npos if none
+		size_t find_quote(size_t off) const
+		{
+			auto q = _mm_set1_epi8('"');
+			auto bs = _mm_set1_epi8('\\');
+			for (; off + 16 <= src_.size(); off += 16) {
+				auto v = _mm_loadu_si128(
+					reinterpret_cast<const __m128i *>(
+						src_.data() + off));
+				auto m = _mm_movemask_epi8(
+					_mm_or_si128(_mm_cmpeq_epi8(v, q),
+						     _mm_cmpeq_epi8(v, bs)));
+				if (m) {
+					return off + __builtin_ctz(m);
 				}
+			}
+			for (; off < src_.size(); ++off) {
+				if (src_[off] == '"' || src_[off] == '\\') {
+					return off;
 				}
 			}
-			return {};
+			return std::string_view::npos;
 		}
 
-		// ensure call after next or behavior is undefined
-		char ch()
+		static void append_utf8(string_t &s, uint32_t cp)
 		{
-			return src_[idx_next_ - 1];
+			auto put = [&s](uint32_t c) {
+				s.push_back(static_cast<char>(c));
+			};
+			if (cp < 0x80) {
+				put(cp);
+			} else if (cp < 0x800) {
+				put(0xc0 | (cp >> 6));
+				put(0x80 | (cp & 0x3f));
+			} else if (cp < 0x10000) {
+				put(0xe0 | (cp >> 12));
+				put(0x80 | ((cp >> 6) & 0x3f));
+				put(0x80 | (cp & 0x3f));
+			} else {
+				put(0xf0 | (cp >> 18));
+				put(0x80 | ((cp >> 12) & 0x3f));
+				put(0x80 | ((cp >> 6) & 0x3f));
+				put(0x80 | (cp & 0x3f));
+			}
 		}
 
-		std::string trace()
+		bool read_hex4(size_t off, uint32_t &cp) const
 		{
-			if (idx_next_ == 0) {
-				return {};
+			if (off + 4 > src_.size()) {
+				return false;
 			}
-			std::ostringstream os;
-			os << "line: " << line_
-			   << ", offset: " << (idx_next_ - 1)
-			   << ", invalid token around: "
-			   << src_.substr(idx_next_ - 1, 10);
-			return os.str();
+			auto b = src_.data() + off;
+			auto r = std::from_chars(b, b + 4, cp, 16);
+			return r.ec == std::errc {} && r.ptr == b + 4;
 		}
 
-		nullable<std::string> read_string(char first)
+		// off is the first hex digit of \\uXXXX, a surrogate pair is
+		// combined into one code point
+		bool read_unicode(size_t &off, string_t &s) const
 		{
-			std::string res;
-			bool escape = false;
-			auto saved_idx = idx_next_ - 1; // simple trace
+			uint32_t cp, lo;
+			if (!read_hex4(off, cp)) {
+				return false;
+			}
+			off += 4;
+			if (cp >= 0xd800 && cp < 0xdc00) {
+				if (at(off) != '\\' || at(off + 1) != 'u' ||
+				    !read_hex4(off + 2, lo) || lo < 0xdc00 ||
+				    lo >= 0xe000) {
+					return false;
+				}
+				off += 6;
+				cp = 0x10000 + ((cp - 0xd800) << 10) +
+				     (lo - 0xdc00);
+			}
+			append_utf8(s, cp);
+			return true;
+		}
+
+		// off is the opening quote, runs without escape are copied in
+		// bulk
+		bool read_string(size_t off, string_t &s) const
+		{
+			++off;
 			while (true) {
-				auto ch = this->next_ch();
-				if (!ch) {
-					idx_next_ = saved_idx;
-					return {};
+				auto q = find_quote(off);
+				if (q == std::string_view::npos) {
+					return false;
 				}
-				if (!escape &&
-				    *ch == first) // next_ch will eat '"'
-				{
-					break;
+				s.append(src_.data() + off, q - off);
+				if (src_[q] == '"') {
+					return true;
 				}
-				switch (*ch) {
+				off = q + 2;
+				switch (at(q + 1)) {
+				case '"':
 				case '\\':
-					if (escape) {
-						escape = false;
-						res.push_back(*ch);
-					} else {
-						escape = true;
+				case '/':
+					s.push_back(src_[q + 1]);
+					break;
+				case 'b':
+					s.push_back('\b');
+					break;
+				case 'f':
+					s.push_back('\f');
+					break;
+				case 'n':
+					s.push_back('\n');
+					break;
+				case 'r':
+					s.push_back('\r');
+					break;
+				case 't':
+					s.push_back('\t');
+					break;
+				case 'u':
+					if (!read_unicode(off, s)) {
+						return false;
 					}
 					break;
 				default:
-					res.push_back(*ch);
-					escape = false;
+					return false;
 				}
 			}
-			return res;
 		}
 
-		// not including NaN, -Inf, Inf
-		nullable<double> read_number(char ch)
+		// the scalar at off is exactly sym
+		bool match(size_t off, std::string_view sym) const
 		{
-			std::string tmp;
-			auto saved_idx = idx_next_ - 1;
-			tmp.push_back(ch);
-			bool doton = false;
-			while (true) {
-				auto n = this->next_ch(); // never eat
-							  // none-is_number
-							  // character
-				if (!n) {
-					idx_next_ = saved_idx;
-					return {};
-				}
-				if ((*n >= '0' && *n <= '9')) {
-					tmp.push_back(*n);
-				} else if (!doton && *n == '.') {
-					doton = true;
-					tmp.push_back(*n);
-				} else {
-					this->back();
-					break;
+			return scalar_end(off) - off == sym.size() &&
+			       src_.compare(off, sym.size(), sym) == 0;
+		}
+
+		enum NumberKind { not_number, real, integer, uinteger };
+
+		// strict JSON number grammar, integers are accumulated on the
+		// way, i is set for integer and u for uinteger, -0 is real to
+		// keep its sign
+		NumberKind scan_number(size_t off, int_t &i, uint_t &u) const
+		{
+			static const char u64_max[] = "18446744073709551615";
+			auto end = scalar_end(off);
+			auto p = src_.data();
+			auto digits = [p, end](size_t &k) {
+				auto b = k;
+				while (k < end && p[k] >= '0' && p[k] <= '9') {
+					++k;
 				}
+				return k - b;
+			};
+			bool neg = at(off) == '-';
+			size_t k = off + neg;
+			size_t b = k;
+			uint64_t v = 0; // wraps past 20 digits, checked below
+			for (; k < end && p[k] >= '0' && p[k] <= '9'; ++k) {
+				v = v * 10 + static_cast<uint64_t>(p[k] - '0');
 			}
-			try {
-				return std::stod(tmp);
+			size_t n = k - b;
+			if (n == 0 || (n > 1 && p[b] == '0')) {
+				return not_number;
 			}
-			catch (...) {
-				return {};
+			bool is_real = false;
+			if (k < end && p[k] == '.') {
+				++k;
+				if (digits(k) == 0) {
+					return not_number;
+				}
+				is_real = true;
 			}
-		}
-
-		nullable<std::string> read_symbol(char first)
-		{
-			std::string res;
-			res.push_back(first);
-			auto saved_idx = idx_next_ - 1;
-			while (true) {
-				auto ch = this->next_ch(); // never eat
-							   // none-symbol
-							   // character
-				if (!ch) {
-					idx_next_ = saved_idx;
-					return {};
+			if (k < end && (p[k] == 'e' || p[k] == 'E')) {
+				++k;
+				k += k < end && (p[k] == '+' || p[k] == '-');
+				if (digits(k) == 0) {
+					return not_number;
 				}
-				if (!isalpha(*ch)) {
-					this->back();
-					break;
+				is_real = true;
+			}
+			if (k != end) {
+				return not_number;
+			}
+			// 20 digits may overflow uint64_t, it's checked first
+			if (is_real || n > 20 ||
+			    (n == 20 && std::memcmp(p + b, u64_max, 20) > 0)) {
+				return real;
+			}
+			if (neg) {
+				if (v == 0 || v > uint64_t { 1 } << 63) {
+					return real;
 				}
-				res.push_back(*ch);
+				i = static_cast<int_t>(0 - v);
+				return integer;
+			}
+			if (v <= INT64_MAX) {
+				i = static_cast<int_t>(v);
+				return integer;
 			}
-			return res;
+			u = v;
+			return uinteger;
 		}
 
-	private:
-		size_t idx_next_;
-		size_t line_;
-		const std::string &src_;
-
-		nullable<char> next_ch()
+		// not including NaN, -Inf, Inf
+		bool read_number(size_t off, number_t &d) const
 		{
-			if (idx_next_ == src_.size()) {
-				return {};
+			int_t i;
+			uint_t u;
+			switch (scan_number(off, i, u)) {
+			case integer:
+				d = static_cast<number_t>(i);
+				return true;
+			case uinteger:
+				d = static_cast<number_t>(u);
+				return true;
+			case real:
+				return read_real(off, d);
+			default:
+				return false;
 			}
-			char c = src_[idx_next_++];
-			return c;
 		}
 
-		void back()
+		// the text is known to be a valid number, from_chars is the
+		// Eisel-Lemire fast path with an exact fallback
+		bool read_real(size_t off, number_t &d) const
 		{
-			if (idx_next_ > 0) {
-				idx_next_ -= 1;
-			}
+			auto b = src_.data() + off;
+			auto e = src_.data() + scalar_end(off);
+			auto r = std::from_chars(b, e, d);
+			return r.ec == std::errc {} && r.ptr == e;
 		}
 	};
 
-	class Parser {
+	// stage 2: walk the structural index and build JsonValues
+	class Parser : Scanner {
 	public:
-		explicit Parser(const std::string &src)
-			: depth_ { 0 }, token_ { src }
+		Parser(std::string_view src, ParseOptions opt)
+			: Scanner { src }, opt_ { opt }, depth_ { 0 },
+			  cur_ { 0 }, idx_ {}
 		{
 		}
 
 		JsonValue parse()
 		{
-			auto token = token_.next();
-			if (!token || *token == Token::Invalid) {
-				return JsonValue::from_trace(token_.trace());
+			if (!Indexer::index(src_, idx_)) {
+				return JsonValue::from_trace(
+					trace(src_.size(), "unclosed string"));
+			}
+			if (idx_.empty()) {
+				return JsonValue::from_trace(
+					trace(src_.size(), "empty document"));
+			}
+			auto v = parse_value();
+			if (v && cur_ != idx_.size()) {
+				return error(idx_[cur_]);
 			}
-			return this->parse_next(*token);
+			return v;
 		}
 
 	private:
+		ParseOptions opt_;
 		size_t depth_;
-		Tokenizer token_;
+		size_t cur_;
+		std::vector<uint32_t> idx_;
 
-		JsonValue parse_next(Token token)
+		std::string trace(size_t off, const char *what)
 		{
-			if (depth_ > max_depth) {
+			auto line = std::count(src_.begin(),
+					       src_.begin() + off,
+					       '\n');
+			std::ostringstream os;
+			os << "line: " << line << ", offset: " << off << ", "
+			   << what << " around: " << src_.substr(off, 10);
+			return os.str();
+		}
+
+		JsonValue error(size_t off)
+		{
+			return JsonValue::from_trace(
+				trace(off, "invalid token"));
+		}
+
+		// position of next structural, src_.size() if none left
+		size_t next()
+		{
+			return cur_ < idx_.size() ? idx_[cur_++] : src_.size();
+		}
+
+		JsonValue parse_value()
+		{
+			if (too_deep(depth_)) {
 				return JsonValue::from_trace(
 					"nested too deeply, nest depth is "
 					"limited to " +
 					std::to_string(max_depth));
 			}
-			switch (token) {
-			case Token::BooleanTrue: {
-				return true;
-			}
-			case Token::BooleanFalse: {
-				return false;
-			}
-			case Token::Number: {
-				auto num = token_.read_number(token_.ch());
-				if (!num) {
-					return JsonValue::from_trace(
-						token_.trace());
-				}
-				return *num;
-			}
-			case Token::String: {
-				auto str = token_.read_string('"');
-				if (!str) {
-					return JsonValue::from_trace(
-						token_.trace());
+			auto off = next();
+			switch (at(off)) {
+			case '{':
+				return parse_object();
+			case '[':
+				return parse_array();
+			case '"': {
+				string_t s;
+				if (!read_string(off, s)) {
+					return error(off);
 				}
-				return std::move(*str);
+				return s;
 			}
-			case Token::BracketOn: {
-				return this->parse_array();
+			case 't':
+				return literal(off, "true", true);
+			case 'f':
+				return literal(off, "false", false);
+			case 'n':
+				return literal(off, "null", null_t {});
+			default:
+				return parse_number(off);
 			}
-			case Token::BraceOn: {
-				return this->parse_object();
+		}
+
+		JsonValue literal(size_t off, std::string_view sym, JsonValue v)
+		{
+			if (!match(off, sym)) {
+				return error(off);
 			}
-			case Token::Null: {
-				return null_t {};
+			return v;
+		}
+
+		JsonValue parse_number(size_t off)
+		{
+			int_t i;
+			uint_t u;
+			switch (scan_number(off, i, u)) {
+			case not_number:
+				return error(off);
+			case integer:
+				if (!opt_.raw_numbers) {
+					return i;
+				}
+				break;
+			case uinteger:
+				if (!opt_.raw_numbers) {
+					return u;
+				}
+				break;
+			case real:
+				break;
 			}
-			default: {
-				return JsonValue::from_trace(token_.trace());
+			if (opt_.raw_numbers) {
+				auto n = scalar_end(off) - off;
+				raw_t r { string_t { src_.substr(off, n) } };
+				return r;
 			}
+			number_t d;
+			if (!read_real(off, d)) {
+				return error(off);
 			}
+			return d;
 		}
 
 		JsonValue parse_array()
 		{
 			++depth_;
-			auto token = token_.next();
-			if (!token || token == Token::Invalid) {
-				return JsonValue::from_trace(token_.trace());
-			}
-
 			array_t a;
-			if (token == Token::BracketOff) {
+			if (cur_ < idx_.size() && at(idx_[cur_]) == ']') {
+				++cur_;
 				--depth_;
 				return a;
 			}
-			auto v = this->parse_next(*token);
-			if (!v) // invalid element
-			{
-				return v;
-			}
-			a.push_back(std::move(v));
-
-			bool done = false;
-			while (!done) {
-				token = token_.next();
-				switch (*token) {
-				case Token::Comma: {
-					v = this->parse();
-					if (!v) {
-						return v;
-					}
-					a.push_back(std::move(v));
-					break;
+			while (true) {
+				auto v = this->parse_value();
+				if (!v) { // invalid element
+					return v;
 				}
-				case Token::BracketOff: {
-					--depth_;
-					done = true;
+				a.push_back(std::move(v));
+				auto off = next();
+				switch (at(off)) {
+				case ',':
 					break;
-				}
-				default: {
-					return JsonValue::from_trace(
-						token_.trace());
-				}
+				case ']':
+					--depth_;
+					return a;
+				default:
+					return error(off);
 				}
 			}
-			return a;
 		}
 
 		JsonValue parse_object()
 		{
 			++depth_;
-			auto token = token_.next();
-			if (!token || *token == Token::Invalid) {
-				return JsonValue::from_trace(token_.trace());
-			}
 			object_t o;
-
-			// parse one or zero k-v pair
-			switch (*token) {
-			case Token::BraceOff: {
+			auto off = next();
+			if (at(off) == '}') {
 				--depth_;
 				return o;
 			}
-			case Token::String: {
-				auto key = token_.read_string('"');
-				if (!key) {
-					return JsonValue::from_trace(
-						token_.trace());
+			while (true) {
+				string_t key;
+				if (at(off) != '"' || !read_string(off, key)) {
+					return error(off);
 				}
-				auto token2 = token_.next();
-				switch (*token2) {
-				case Token::Colon:
-					break;
-				default:
-					return JsonValue::from_trace(
-						token_.trace());
+				off = next();
+				if (at(off) != ':') {
+					return error(off);
 				}
-				auto value = this->parse(); // maybe sub-object
-				if (!value) // invalid value
-				{
+				// maybe sub-object
+				auto value = this->parse_value();
+				if (!value) { // invalid value
 					return value;
 				}
-				o.emplace(*key, std::move(value));
-				break;
-			}
-			default: {
-				return JsonValue::from_trace(token_.trace());
-			}
-			}
-
-			// parse rest k-v pairs
-			bool done = false;
-			while (!done) {
-				token = token_.next();
-				switch (*token) {
-				case Token::Comma: {
-					nullable<std::string> key;
-					auto token2 = token_.next();
-					switch (*token2) {
-					case Token::String:
-						key = token_.read_string('"');
-						if (!key) {
-							return JsonValue::from_trace(
-								token_.trace());
-						}
-						break;
-					default:
-						return JsonValue::from_trace(
-							token_.trace());
-					}
-					token2 = token_.next();
-					switch (*token2) {
-					case Token::Colon:
-						break;
-					default:
-						return JsonValue::from_trace(
-							token_.trace());
-					}
-					auto value = this->parse();
-					if (!value) {
-						return value;
-					}
-					o.emplace(*key, std::move(value));
+				o.emplace(std::move(key), std::move(value));
+				off = next();
+				switch (at(off)) {
+				case ',':
+					off = next();
 					break;
-				}
-				case Token::BraceOff:
+				case '}':
 					--depth_;
-					done = true;
-					break;
+					return o;
 				default:
-					return JsonValue::from_trace(
-						token_.trace());
+					return error(off);
 				}
 			}
-			return o;
 		}
 	};
 } // namespace detail
 
-JsonValue parse(const std::string &src)
+inline JsonValue parse(std::string_view src, ParseOptions opt = {})
 {
-	detail::Parser p { src };
+	detail::Parser p { src, opt };
 	return p.parse();
 }
 } // namespace nm::json
@@ -5,8 +5,456 @@
 	Created Time: 12/29/20 2:22 PM
 ***********************************************/
 
+#include "binary.h"
+#include "binding.h"
 #include "json.h"
+#include "ondemand.h"
+#include "pointer.h"
+#include "stream.h"
+#include <instant/instant.h>
 #include <iostream>
+#include <malloc.h>
+
+static std::string make_doc(int n)
+{
+	std::ostringstream os;
+	os << '[';
+	for (int i = 0; i < n; ++i) {
+		if (i) {
+			os << ',';
+		}
+		os << R"({"id":)" << i << R"(,"name":"user_)" << i
+		   << R"(","score":)" << i * 0.5
+		   << R"(,"tags":["red","green","blue"],"active":true,)"
+		   << R"("profile":{"age":)" << i % 90
+		   << R"(,"city":"Shanghai","note":null}})";
+	}
+	os << ']';
+	return os.str();
+}
+
+static uint64_t heap_bytes()
+{
+	auto mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+static void bench_parse()
+{
+	auto doc = make_doc(50000);
+	auto before = heap_bytes();
+	auto b = nm::Instant::now();
+	auto r = nm::json::parse(doc);
+	auto ms = b.elapse_ms();
+	auto held = heap_bytes() - before;
+
+	std::cout << "-------------------------------\n";
+	std::cout << "parse " << doc.size() / 1e6 << "MB in " << ms
+		  << "ms, " << doc.size() / 1e3 / ms << "MB/s, holding "
+		  << held / 1e6 << "MB, ok: " << (bool)r << '\n';
+}
+
+// read two fields of one record, the router case
+static void bench_ondemand()
+{
+	auto doc = make_doc(50000);
+	auto b = nm::Instant::now();
+	auto r = nm::json::parse(doc);
+	auto dom = r[42]["profile"]["city"].get<nm::json::string_t>();
+	auto dom_ms = b.elapse_ms();
+
+	b = nm::Instant::now();
+	nm::json::ondemand::Document d { doc };
+	auto city = d[42]["profile"]["city"].get_string();
+	auto lazy_ms = b.elapse_ms();
+
+	std::cout << "dom: " << dom << " in " << dom_ms << "ms, on-demand: "
+		  << city.value_or("?") << " in " << lazy_ms << "ms\n";
+}
+
+static void ondemand()
+{
+	std::string s {
+		R"({"name":"elder","tags":["a\tb","c"],"age":1926.8})"
+	};
+	nm::json::ondemand::Document d { s };
+
+	std::cout << "-------------------------------\n";
+	std::cout << "name: " << d["name"].get_string().value_or("") << '\n';
+	std::cout << "age: " << d["age"].get_number().value_or(0) << '\n';
+	for (auto v : d["tags"]) {
+		std::cout << "tag: " << v.get_string().value_or("") << '\n';
+	}
+	for (auto it = d.root().begin(); it != d.root().end(); ++it) {
+		auto f = it.field();
+		std::cout << f.key << " => " << f.value.raw() << '\n';
+	}
+	std::cout << "missing: " << (bool)d["tags"][2] << '\n';
+}
+
+struct Profile {
+	double age = 0;
+	std::string city;
+	std::optional<std::string> note;
+};
+
+struct Record {
+	uint64_t id = 0;
+	std::string name;
+	double score = 0;
+	std::vector<std::string> tags;
+	bool active = false;
+	Profile profile;
+};
+
+template<>
+struct nm::json::Binding<Profile> {
+	static constexpr auto fields =
+		std::make_tuple(nm::json::field("age", &Profile::age),
+				nm::json::field("city", &Profile::city),
+				nm::json::field("note", &Profile::note));
+};
+
+template<>
+struct nm::json::Binding<Record> {
+	static constexpr auto fields =
+		std::make_tuple(nm::json::field("id", &Record::id),
+				nm::json::field("name", &Record::name),
+				nm::json::field("score", &Record::score),
+				nm::json::field("tags", &Record::tags),
+				nm::json::field("active", &Record::active),
+				nm::json::field("profile", &Record::profile));
+};
+
+struct Records {
+	std::vector<Record> items;
+};
+
+template<>
+struct nm::json::Binding<Records> {
+	static constexpr auto fields =
+		std::make_tuple(nm::json::field("items", &Records::items));
+};
+
+// the same records through the DOM and copied out field by field, and bound
+static void bench_binding()
+{
+	using namespace nm::json;
+	auto doc = R"({"items":)" + make_doc(50000) + "}";
+
+	auto b = nm::Instant::now();
+	auto r = parse(doc);
+	std::vector<Record> dom;
+	for (auto &v : r["items"].get<array_t>()) {
+		auto &o = v.get<object_t>();
+		auto &p = o["profile"].get<object_t>();
+		Record x;
+		x.id = o["id"].get<int_t>();
+		x.name = o["name"].get<string_t>();
+		x.score = o["score"].to_number();
+		for (auto &t : o["tags"].get<array_t>()) {
+			x.tags.push_back(t.get<string_t>());
+		}
+		x.active = o["active"].get<bool_t>();
+		x.profile.age = p["age"].to_number();
+		x.profile.city = p["city"].get<string_t>();
+		dom.push_back(std::move(x));
+	}
+	auto dom_ms = b.elapse_ms();
+
+	b = nm::Instant::now();
+	auto bound = read<Records>(doc);
+	auto read_ms = b.elapse_ms();
+
+	std::string buf;
+	b = nm::Instant::now();
+	write(*bound, buf);
+	auto write_ms = b.elapse_ms();
+
+	std::cout << "-------------------------------\n";
+	std::cout << "records " << dom.size() << ": dom + copy " << dom_ms
+		  << "ms, read " << read_ms << "ms, write " << write_ms
+		  << "ms, same: " << (bound->items.size() == dom.size())
+		  << '\n';
+	buf.clear();
+	write(bound->items[7], buf);
+	std::cout << buf << '\n';
+}
+
+// 64 bit ids and timestamps, they must come back exactly
+static void bench_numbers()
+{
+	std::string doc { "[" };
+	for (uint64_t i = 0; i < 1000000; ++i) {
+		doc += i ? "," : "";
+		doc += std::to_string(1700000000000000000 + i * 7919);
+	}
+	doc += "]";
+
+	auto b = nm::Instant::now();
+	auto r = nm::json::parse(doc);
+	auto ms = b.elapse_ms();
+	auto raw = nm::json::parse(doc, { .raw_numbers = true });
+	bool exact = r.to_string() == doc && raw.to_string() == doc;
+
+	std::cout << "-------------------------------\n";
+	std::cout << "1M int64 ids " << doc.size() / 1e6 << "MB in " << ms
+		  << "ms, " << doc.size() / 1e3 / ms << "MB/s, exact: " << exact
+		  << '\n';
+}
+
+// NDJSON cut into odd sized chunks, as a socket would deliver it
+static void stream()
+{
+	std::string s { "{\"id\":1,\"msg\":\"a\\nb\"}\n[true,null]\n-2.5e1\n" };
+	nm::json::ValueStream vs { [](nm::json::JsonValue &&v) {
+		std::cout << "record: " << v << '\n';
+	} };
+
+	std::cout << "-------------------------------\n";
+	for (size_t i = 0; i < s.size(); i += 3) {
+		vs.feed(std::string_view { s }.substr(i, 3));
+	}
+	if (!vs.finish()) {
+		std::cout << vs.trace() << '\n';
+	}
+}
+
+static void bench_stream()
+{
+	struct Counter : nm::json::SaxHandler {
+		size_t n = 0;
+		void on_key(std::string_view)
+		{
+			n += 1;
+		}
+	} c;
+	auto doc = make_doc(50000);
+	nm::json::StreamParser<Counter> p { c };
+	auto b = nm::Instant::now();
+	for (size_t i = 0; i < doc.size(); i += 4096) {
+		p.feed(std::string_view { doc }.substr(i, 4096));
+	}
+	auto ok = p.finish();
+	auto ms = b.elapse_ms();
+
+	std::cout << "sax " << doc.size() / 1e6 << "MB in 4KB chunks in "
+		  << ms << "ms, " << doc.size() / 1e3 / ms << "MB/s, keys "
+		  << c.n << ", ok: " << ok << '\n';
+}
+
+// the ostringstream serializer JsonValue::to_string used before, kept here
+// as the baseline of bench_write
+static void legacy_write(std::ostringstream &os,
+			 nm::json::JsonValue &v,
+			 size_t indent,
+			 size_t cur)
+{
+	using namespace nm::json;
+	auto space = [&os](size_t n) {
+		while (n-- > 0) {
+			os << ' ';
+		}
+	};
+	auto escape = [&os](const std::string &s) {
+		os << '"';
+		for (auto c : s) {
+			if (c == '"' || c == '\\') {
+				os << '\\';
+			}
+			os << c;
+		}
+		os << '"';
+	};
+	if (v.is_null()) {
+		os << "null";
+	} else if (v.is_boolean()) {
+		os << v.get<bool_t>();
+	} else if (v.is_number()) {
+		auto s = std::to_string(v.to_number());
+		s = s.substr(0, s.find_last_not_of('0') + 1);
+		if (!s.empty() && s.back() == '.') {
+			s.pop_back();
+		}
+		os << s;
+	} else if (v.is_string()) {
+		escape(v.get<string_t>());
+	} else if (v.is_array()) {
+		auto &a = v.get<array_t>();
+		os << "[\n";
+		for (size_t i = 0; i < a.size(); ++i) {
+			space(cur);
+			legacy_write(os, a[i], indent, cur + indent);
+			os << (i + 1 < a.size() ? ",\n" : "\n");
+		}
+		space(cur - indent);
+		os << ']';
+	} else if (v.is_object()) {
+		auto &o = v.get<object_t>();
+		size_t i = 0;
+		os << "{\n";
+		for (auto &[k, e] : o) {
+			space(cur);
+			escape(k);
+			os << ": ";
+			legacy_write(os, e, indent, cur + indent);
+			os << (++i < o.size() ? ",\n" : "\n");
+		}
+		space(cur - indent);
+		os << '}';
+	}
+}
+
+static void bench_write()
+{
+	auto r = nm::json::parse(make_doc(50000));
+	auto b = nm::Instant::now();
+	std::ostringstream os;
+	os << std::boolalpha;
+	legacy_write(os, r, 2, 2);
+	auto legacy = os.str();
+	auto legacy_ms = b.elapse_ms();
+
+	std::string buf;
+	b = nm::Instant::now();
+	r.write(buf, 2);
+	auto ms = b.elapse_ms();
+
+	// a reused buffer does not grow again
+	b = nm::Instant::now();
+	buf.clear();
+	r.write(buf, 2);
+	auto reuse_ms = b.elapse_ms();
+
+	std::cout << "-------------------------------\n";
+	std::cout << "to_string(2) " << legacy.size() / 1e6
+		  << "MB: ostringstream " << legacy_ms << "ms, write " << ms
+		  << "ms, write reused " << reuse_ms << "ms\n";
+}
+
+static void pointer()
+{
+	std::string s {
+		R"({"a/b":{"m~n":[10,20]},"hobby":{"ha":"+1s","mo":["x","y"]}})"
+	};
+	auto r = nm::json::parse(s);
+	nm::json::PathSet set;
+	for (auto e : { "/a~1b/m~0n/1", "$.hobby['ha']", "$.hobby.mo[1]",
+			"/hobby/none", "$" }) {
+		if (auto p = nm::json::Path::compile(e)) {
+			set.add(*p);
+		}
+	}
+
+	std::cout << "-------------------------------\n";
+	std::vector<nm::json::JsonValue *> dom;
+	set.find(r, dom);
+	nm::json::ondemand::Document d { s };
+	std::vector<nm::json::ondemand::Value> lazy;
+	set.find(d, lazy);
+	for (size_t i = 0; i < set.size(); ++i) {
+		std::cout << "path " << i << ": "
+			  << (dom[i] ? dom[i]->to_string() : "missing")
+			  << " | " << lazy[i].raw() << '\n';
+	}
+
+	nm::json::PathExtractor px { set, [](auto &out) {
+		std::cout << "stream: " << out[0] << ' ' << out[2] << '\n';
+	} };
+	nm::json::StreamParser<decltype(px)> sp { px };
+	sp.feed(s);
+	sp.finish();
+	std::cout << "bad: " << !nm::json::Path::compile("$.a[01]") << '\n';
+}
+
+// pick three fields of one record, compiled path against chained lookups
+static void bench_pointer()
+{
+	auto doc = make_doc(50000);
+	auto r = nm::json::parse(doc);
+	auto p = *nm::json::Path::compile("/42000/profile/city");
+	size_t hit = 0;
+	auto b = nm::Instant::now();
+	for (int i = 0; i < 100; ++i) {
+		hit += r[42000]["profile"]["city"].is_string();
+	}
+	auto chain_ms = b.elapse_ms();
+	b = nm::Instant::now();
+	for (int i = 0; i < 100; ++i) {
+		hit += p.find(r) != nullptr;
+	}
+	auto path_ms = b.elapse_ms();
+
+	nm::json::PathSet set;
+	for (auto e :
+	     { "$[42000].id", "$[42000].name", "$[42000].profile.age" }) {
+		set.add(*nm::json::Path::compile(e));
+	}
+	nm::json::ondemand::Document d { doc };
+	std::vector<nm::json::ondemand::Value> out;
+	b = nm::Instant::now();
+	set.find(d, out);
+	auto set_ms = b.elapse_ms();
+
+	size_t n = 0;
+	nm::json::PathExtractor px { set, [&n](auto &v) {
+		n += v[2].is_number();
+	} };
+	nm::json::StreamParser<decltype(px)> sp { px };
+	b = nm::Instant::now();
+	for (size_t i = 0; i < doc.size(); i += 4096) {
+		sp.feed(std::string_view { doc }.substr(i, 4096));
+	}
+	sp.finish();
+	auto stream_ms = b.elapse_ms();
+
+	std::cout << "100 lookups, chained: " << chain_ms
+		  << "ms, compiled: " << path_ms << "ms, hits " << hit << '\n';
+	std::cout << "3 paths, on-demand: " << set_ms << "ms "
+		  << out[1].raw() << ", streaming: " << stream_ms << "ms "
+		  << n << '\n';
+}
+
+// the same records as text and binary, whole documents and one field
+static void bench_binary()
+{
+	auto doc = make_doc(50000);
+	auto r = nm::json::parse(doc);
+	std::string text;
+	std::string bin;
+	auto b = nm::Instant::now();
+	r.write(text);
+	auto write_ms = b.elapse_ms();
+	b = nm::Instant::now();
+	nm::json::binary::encode(r, bin);
+	auto encode_ms = b.elapse_ms();
+
+	b = nm::Instant::now();
+	auto t = nm::json::parse(text);
+	auto parse_ms = b.elapse_ms();
+	b = nm::Instant::now();
+	auto d = nm::json::binary::decode(bin);
+	auto decode_ms = b.elapse_ms();
+
+	b = nm::Instant::now();
+	nm::json::ondemand::Document od { text };
+	auto c1 = od[42000]["profile"]["city"].get_string();
+	auto lazy_ms = b.elapse_ms();
+	b = nm::Instant::now();
+	nm::json::binary::Value bv { bin };
+	auto c2 = bv[42000]["profile"]["city"].get_string();
+	auto skip_ms = b.elapse_ms();
+
+	std::cout << "-------------------------------\n";
+	std::cout << "text " << text.size() / 1e6 << "MB, binary "
+		  << bin.size() / 1e6 << "MB\n";
+	std::cout << "write " << write_ms << "ms, encode " << encode_ms
+		  << "ms, parse " << parse_ms << "ms, decode " << decode_ms
+		  << "ms, same: " << (t.to_string() == d.to_string()) << '\n';
+	std::cout << "one field, on-demand text " << lazy_ms << "ms "
+		  << c1.value_or("?") << ", binary " << skip_ms << "ms "
+		  << c2.value_or("?") << '\n';
+}
 
 int main()
 {
@@ -53,5 +501,17 @@ int main()
 	std::cout << j.to_string() << '\n';
 	std::cout << std::setprecision(9) << j["age"] << '\n';
 	std::cout << j["\tmotto\t"][0] << j["\tmotto\t"][1] << '\n';
+
+	ondemand();
+	bench_parse();
+	bench_ondemand();
+	stream();
+	bench_stream();
+	bench_write();
+	bench_binding();
+	bench_numbers();
+	pointer();
+	bench_pointer();
+	bench_binary();
 	return 0;
 }
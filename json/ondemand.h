@@ -0,0 +1,519 @@
+/***********************************************
+	File Name: ondemand.h
+	Author: Abby Cin
+	Mail: abbytsing@gmail.com
+	Created Time: 10/18/26 2:10 PM
+***********************************************/
+
+#ifndef JSON_ONDEMAND_H_
+#define JSON_ONDEMAND_H_
+
+#include "json.h"
+#include <optional>
+#include <unordered_map>
+
+// lazy access to a json document without building JsonValues, the input is
+// indexed once by stage 1, then only the path the caller walks is looked at,
+// siblings are skipped by bracket matching on the index
+//
+//	nm::json::ondemand::Document doc { buf };
+//	auto id = doc["user"]["ids"][3].get_number();
+//
+// NOTE: the source buffer must outlive the Document, a Document must outlive
+// the Values taken from it, and only the parts that are touched get checked,
+// a syntax error in a skipped sibling is not reported
+namespace nm::json::ondemand
+{
+class Document;
+
+class Value {
+	friend class Document;
+
+public:
+	struct Field;
+	class Iterator;
+
+	Value() : doc_ { nullptr }, pos_ { 0 }
+	{
+	}
+
+	// false if the path that led here does not exist
+	explicit operator bool() const
+	{
+		return doc_ != nullptr;
+	}
+
+	[[nodiscard]] bool is_object() const
+	{
+		return peek() == '{';
+	}
+
+	[[nodiscard]] bool is_array() const
+	{
+		return peek() == '[';
+	}
+
+	[[nodiscard]] bool is_string() const
+	{
+		return peek() == '"';
+	}
+
+	[[nodiscard]] bool is_boolean() const
+	{
+		return peek() == 't' || peek() == 'f';
+	}
+
+	[[nodiscard]] bool is_null() const
+	{
+		return peek() == 'n';
+	}
+
+	[[nodiscard]] bool is_number() const
+	{
+		auto c = peek();
+		return c == '-' || (c >= '0' && c <= '9');
+	}
+
+	// member lookup, invalid if not an object or key is missing
+	inline Value operator[](std::string_view key) const;
+	// element lookup, invalid if not an array or out of range
+	inline Value operator[](size_t i) const;
+
+	// strings without escape are viewed in the source buffer, others are
+	// decoded into storage owned by the Document
+	inline std::optional<std::string_view> get_string() const;
+	inline std::optional<number_t> get_number() const;
+	// exact integers, nullopt if the number has a fraction, an exponent
+	// or does not fit
+	inline std::optional<int_t> get_int() const;
+	inline std::optional<uint_t> get_uint() const;
+	inline std::optional<bool_t> get_bool() const;
+
+	// the raw text of this value, including quotes or brackets
+	inline std::string_view raw() const;
+
+	// build a JsonValue of this subtree only
+	inline JsonValue materialize() const;
+
+	// iterate elements of an array or fields of an object, empty range
+	// for anything else
+	inline Iterator begin() const;
+	inline Iterator end() const;
+
+private:
+	const Document *doc_;
+	uint32_t pos_; // index of the first structural of this value
+
+	Value(const Document *doc, uint32_t pos) : doc_ { doc }, pos_ { pos }
+	{
+	}
+
+	inline char peek() const;
+};
+
+// an object field, value is only located when asked for
+struct Value::Field {
+	std::string_view key; // raw, still escaped
+	Value value;
+};
+
+class Value::Iterator {
+	friend class Value;
+
+public:
+	Iterator() : doc_ { nullptr }, pos_ { 0 }, object_ { false }
+	{
+	}
+
+	bool operator==(const Iterator &r) const
+	{
+		return doc_ == r.doc_ && pos_ == r.pos_;
+	}
+
+	bool operator!=(const Iterator &r) const
+	{
+		return !(*this == r);
+	}
+
+	inline Iterator &operator++();
+
+	// for objects the element is the field value, see field()
+	inline Value operator*() const;
+
+	// false once ++ found the members are not separated by ',' or not
+	// closed by the bracket, the iterator is at end() then
+	[[nodiscard]] bool ok() const
+	{
+		return ok_;
+	}
+
+	// key and value are empty and invalid if the field is malformed
+	inline Field field() const;
+
+	// unescaped key of the current field, escaped keys are decoded into
+	// buf, nullopt on a bad escape or a malformed field
+	inline std::optional<std::string_view> key(string_t &buf) const;
+
+private:
+	const Document *doc_;
+	uint32_t pos_;
+	bool object_;
+	bool ok_ = true;
+
+	Iterator(const Document *doc, uint32_t pos, bool object)
+		: doc_ { doc }, pos_ { pos }, object_ { object }
+	{
+	}
+};
+
+class Document {
+	friend class Value;
+	friend class Value::Iterator;
+
+public:
+	explicit Document(std::string_view src) : scan_ { src }, idx_ {}
+	{
+		ok_ = detail::Indexer::index(src, idx_) && !idx_.empty();
+	}
+
+	Document(const Document &) = delete;
+	Document &operator=(const Document &) = delete;
+
+	explicit operator bool() const
+	{
+		return ok_;
+	}
+
+	Value root() const
+	{
+		return ok_ ? Value { this, 0 } : Value {};
+	}
+
+	Value operator[](std::string_view key) const
+	{
+		return root()[key];
+	}
+
+	Value operator[](size_t i) const
+	{
+		return root()[i];
+	}
+
+private:
+	detail::Scanner scan_;
+	std::vector<uint32_t> idx_;
+	// escaped strings decoded once, by structural index, nodes keep the
+	// views handed out valid
+	mutable std::unordered_map<uint32_t, std::string> decoded_ {};
+	bool ok_;
+
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	// byte offset of the i-th structural
+	size_t off(uint32_t i) const
+	{
+		return i < idx_.size() ? idx_[i] : scan_.src_.size();
+	}
+
+	char at(uint32_t i) const
+	{
+		return scan_.at(off(i));
+	}
+
+	// index just past the value starting at i
+	uint32_t skip(uint32_t i) const
+	{
+		auto c = at(i);
+		if (c != '{' && c != '[') {
+			return i + 1;
+		}
+		size_t depth = 0;
+		for (; i < idx_.size(); ++i) {
+			switch (at(i)) {
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0) {
+					return i + 1;
+				}
+				break;
+			default:
+				break;
+			}
+		}
+		return npos;
+	}
+
+	// raw string between the quotes at structural i, nullopt if there is
+	// no string or it runs off the end
+	std::optional<std::string_view> raw_string(uint32_t i,
+						   bool &escaped) const
+	{
+		escaped = false;
+		if (at(i) != '"') {
+			return std::nullopt;
+		}
+		constexpr auto none = std::string_view::npos;
+		auto b = off(i) + 1;
+		auto q = scan_.find_quote(b);
+		while (q != none && scan_.src_[q] == '\\') {
+			escaped = true;
+			q = scan_.find_quote(q + 2);
+		}
+		if (q == none) {
+			return std::nullopt;
+		}
+		return scan_.src_.substr(b, q - b);
+	}
+
+	// key of the member at structural i, nullopt if it isn't "key":
+	std::optional<std::string_view> raw_key(uint32_t i,
+						bool &escaped) const
+	{
+		if (at(i + 1) != ':') {
+			escaped = false;
+			return std::nullopt;
+		}
+		return raw_string(i, escaped);
+	}
+
+	// i is the opening of a container, return the first member or npos
+	uint32_t first(uint32_t i, char close) const
+	{
+		return at(i + 1) == close ? npos : i + 1;
+	}
+
+	// i is a member, return the next one or npos, ok is cleared when the
+	// member is followed by neither ',' nor the closing bracket
+	uint32_t next(uint32_t i, bool object, bool &ok) const
+	{
+		if (object && at(i + 1) != ':') {
+			ok = false;
+			return npos;
+		}
+		auto j = skip(object ? i + 2 : i);
+		if (j != npos && at(j) == ',') {
+			return j + 1;
+		}
+		ok = j != npos && at(j) == (object ? '}' : ']');
+		return npos;
+	}
+
+	uint32_t next(uint32_t i, bool object) const
+	{
+		bool ok;
+		return next(i, object, ok);
+	}
+
+	bool key_equal(uint32_t i, std::string_view key) const
+	{
+		bool escaped;
+		auto raw = raw_key(i, escaped);
+		if (!raw) {
+			return false;
+		}
+		if (!escaped) {
+			return *raw == key;
+		}
+		string_t s;
+		return scan_.read_string(off(i), s) && s == key;
+	}
+};
+
+char Value::peek() const
+{
+	return doc_ ? doc_->at(pos_) : '\0';
+}
+
+Value Value::operator[](std::string_view key) const
+{
+	if (!is_object()) {
+		return {};
+	}
+	for (auto i = doc_->first(pos_, '}'); i != Document::npos;
+	     i = doc_->next(i, true)) {
+		if (doc_->key_equal(i, key)) {
+			return { doc_, i + 2 };
+		}
+	}
+	return {};
+}
+
+Value Value::operator[](size_t n) const
+{
+	if (!is_array()) {
+		return {};
+	}
+	for (auto i = doc_->first(pos_, ']'); i != Document::npos;
+	     i = doc_->next(i, false)) {
+		if (n-- == 0) {
+			return { doc_, i };
+		}
+	}
+	return {};
+}
+
+std::optional<std::string_view> Value::get_string() const
+{
+	if (!is_string()) {
+		return std::nullopt;
+	}
+	bool escaped;
+	auto raw = doc_->raw_string(pos_, escaped);
+	if (!raw || !escaped) {
+		return raw;
+	}
+	auto [it, fresh] = doc_->decoded_.try_emplace(pos_);
+	if (fresh && !doc_->scan_.read_string(doc_->off(pos_), it->second)) {
+		doc_->decoded_.erase(it);
+		return std::nullopt;
+	}
+	return it->second;
+}
+
+std::optional<number_t> Value::get_number() const
+{
+	number_t d;
+	if (!is_number() || !doc_->scan_.read_number(doc_->off(pos_), d)) {
+		return std::nullopt;
+	}
+	return d;
+}
+
+std::optional<int_t> Value::get_int() const
+{
+	int_t i;
+	uint_t u;
+	if (!is_number() || doc_->scan_.scan_number(doc_->off(pos_), i, u) !=
+				    detail::Scanner::integer) {
+		return std::nullopt;
+	}
+	return i;
+}
+
+std::optional<uint_t> Value::get_uint() const
+{
+	int_t i;
+	uint_t u;
+	if (!is_number()) {
+		return std::nullopt;
+	}
+	switch (doc_->scan_.scan_number(doc_->off(pos_), i, u)) {
+	case detail::Scanner::integer:
+		if (i < 0) {
+			return std::nullopt;
+		}
+		return static_cast<uint_t>(i);
+	case detail::Scanner::uinteger:
+		return u;
+	default:
+		return std::nullopt;
+	}
+}
+
+std::optional<bool_t> Value::get_bool() const
+{
+	if (!is_boolean()) {
+		return std::nullopt;
+	}
+	auto off = doc_->off(pos_);
+	if (doc_->scan_.match(off, "true")) {
+		return true;
+	}
+	if (doc_->scan_.match(off, "false")) {
+		return false;
+	}
+	return std::nullopt;
+}
+
+std::string_view Value::raw() const
+{
+	if (!doc_) {
+		return {};
+	}
+	auto b = doc_->off(pos_);
+	auto &src = doc_->scan_.src_;
+	switch (peek()) {
+	case '{':
+	case '[': {
+		auto end = doc_->skip(pos_);
+		if (end == Document::npos) {
+			return {};
+		}
+		return src.substr(b, doc_->off(end - 1) + 1 - b);
+	}
+	case '"': {
+		bool escaped;
+		auto s = doc_->raw_string(pos_, escaped);
+		return s ? src.substr(b, s->size() + 2) : std::string_view {};
+	}
+	default:
+		return src.substr(b, doc_->scan_.scalar_end(b) - b);
+	}
+}
+
+JsonValue Value::materialize() const
+{
+	auto s = raw();
+	if (s.empty()) {
+		return {};
+	}
+	return parse(s);
+}
+
+Value::Iterator Value::begin() const
+{
+	if (is_object()) {
+		return { doc_, doc_->first(pos_, '}'), true };
+	}
+	if (is_array()) {
+		return { doc_, doc_->first(pos_, ']'), false };
+	}
+	return end();
+}
+
+Value::Iterator Value::end() const
+{
+	return { doc_, Document::npos, is_object() };
+}
+
+Value::Iterator &Value::Iterator::operator++()
+{
+	pos_ = doc_->next(pos_, object_, ok_);
+	return *this;
+}
+
+Value Value::Iterator::operator*() const
+{
+	return { doc_, object_ ? pos_ + 2 : pos_ };
+}
+
+Value::Field Value::Iterator::field() const
+{
+	bool escaped;
+	auto k = doc_->raw_key(pos_, escaped);
+	if (!k) {
+		return {};
+	}
+	return { *k, { doc_, pos_ + 2 } };
+}
+
+std::optional<std::string_view> Value::Iterator::key(string_t &buf) const
+{
+	bool escaped;
+	auto raw = doc_->raw_key(pos_, escaped);
+	if (!raw || !escaped) {
+		return raw;
+	}
+	buf.clear();
+	if (!doc_->scan_.read_string(doc_->off(pos_), buf)) {
+		return std::nullopt;
+	}
+	return buf;
+}
+} // namespace nm::json::ondemand
+
+#endif // JSON_ONDEMAND_H_
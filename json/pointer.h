@@ -0,0 +1,541 @@
+/***********************************************
+	File Name: pointer.h
+	Author: Abby Cin
+	Mail: abbytsing@gmail.com
+	Created Time: 10/18/26 8:40 PM
+***********************************************/
+
+#ifndef JSON_POINTER_H_
+#define JSON_POINTER_H_
+
+#include "ondemand.h"
+#include "stream.h"
+
+// precompiled paths, parsed once and evaluated against many documents
+//
+//	auto p = nm::json::Path::compile("/hobby/profile/0");	// JSON Pointer
+//	auto q = nm::json::Path::compile("$.hobby['ha']");	// JSONPath
+//	JsonValue *v = p->find(dom);
+//
+// a PathSet merges many paths into a trie and extracts all of them in one
+// walk, from a DOM, an ondemand::Document or a stream through PathExtractor,
+// the latter two never build unrelated subtrees
+// NOTE: the JSONPath subset is $, .name, ['name'] and [n], no wildcards,
+// filters nor recursive descent
+namespace nm::json
+{
+class Path {
+public:
+	struct Step {
+		enum Kind : uint8_t {
+			key,   // object member only, JSONPath .name or ['name']
+			index, // array element only, JSONPath [n]
+			either // JSON Pointer token, digits may address both
+		};
+		string_t name;
+		size_t pos; // array index, npos if name is not one
+		Kind kind;
+
+		bool operator==(const Step &r) const
+		{
+			return kind == r.kind && pos == r.pos && name == r.name;
+		}
+
+		bool match_key(std::string_view k) const
+		{
+			return kind != index && name == k;
+		}
+
+		bool match_index(size_t i) const
+		{
+			return kind != key && pos == i;
+		}
+	};
+
+	static constexpr size_t npos = SIZE_MAX;
+
+	// a JSON Pointer ("" or starting with '/') or a JSONPath starting
+	// with '$', nullopt if malformed
+	static std::optional<Path> compile(std::string_view expr)
+	{
+		Path p;
+		bool ok = false;
+		if (expr.empty() || expr[0] == '/') {
+			ok = p.pointer(expr);
+		} else if (expr[0] == '$') {
+			ok = p.jsonpath(expr.substr(1));
+		}
+		return ok ? std::optional { std::move(p) } : std::nullopt;
+	}
+
+	const std::vector<Step> &steps() const
+	{
+		return steps_;
+	}
+
+	// nullptr if missing
+	JsonValue *find(JsonValue &root) const
+	{
+		JsonValue *v = &root;
+		for (auto &s : steps_) {
+			if (!(v = step(*v, s))) {
+				break;
+			}
+		}
+		return v;
+	}
+
+	// invalid Value if missing
+	ondemand::Value find(ondemand::Value v) const
+	{
+		for (auto &s : steps_) {
+			if (v.is_object() && s.kind != Step::index) {
+				v = v[std::string_view { s.name }];
+			} else if (v.is_array() && s.kind != Step::key) {
+				v = v[s.pos];
+			} else {
+				return {};
+			}
+		}
+		return v;
+	}
+
+	ondemand::Value find(const ondemand::Document &doc) const
+	{
+		return find(doc.root());
+	}
+
+	static JsonValue *step(JsonValue &v, const Step &s)
+	{
+		if (auto o = v.as<object_t>(); o && s.kind != Step::index) {
+			auto it = o->find(s.name);
+			return it == o->end() ? nullptr : &it->second;
+		}
+		if (auto a = v.as<array_t>(); a && s.pos < a->size()) {
+			return s.kind != Step::key ? &(*a)[s.pos] : nullptr;
+		}
+		return nullptr;
+	}
+
+private:
+	std::vector<Step> steps_ {};
+
+	// digits without leading zero, npos otherwise
+	static size_t to_index(std::string_view s)
+	{
+		size_t n = 0;
+		if (s.empty() || (s.size() > 1 && s[0] == '0')) {
+			return npos;
+		}
+		auto r = std::from_chars(s.data(), s.data() + s.size(), n);
+		if (r.ec != std::errc {} || r.ptr != s.data() + s.size()) {
+			return npos;
+		}
+		return n;
+	}
+
+	// RFC 6901, ~1 is '/' and ~0 is '~'
+	bool pointer(std::string_view expr)
+	{
+		while (!expr.empty()) {
+			expr.remove_prefix(1);
+			auto end = std::min(expr.find('/'), expr.size());
+			string_t name;
+			for (size_t i = 0; i < end; ++i) {
+				if (expr[i] != '~') {
+					name.push_back(expr[i]);
+				} else if (i + 1 < end && expr[i + 1] == '0') {
+					name.push_back('~');
+					++i;
+				} else if (i + 1 < end && expr[i + 1] == '1') {
+					name.push_back('/');
+					++i;
+				} else {
+					return false;
+				}
+			}
+			// only a token of digits may address an array
+			auto pos = to_index(name);
+			auto kind = pos == npos ? Step::key : Step::either;
+			steps_.push_back({ std::move(name), pos, kind });
+			expr.remove_prefix(end);
+		}
+		return true;
+	}
+
+	bool jsonpath(std::string_view expr)
+	{
+		while (!expr.empty()) {
+			if (expr[0] == '.') {
+				auto end = expr.find_first_of(".[", 1);
+				end = std::min(end, expr.size());
+				if (end == 1) {
+					return false;
+				}
+				add_key(expr.substr(1, end - 1));
+				expr.remove_prefix(end);
+			} else if (expr[0] == '[') {
+				auto end = expr.find(']');
+				if (end == expr.npos ||
+				    !bracket(expr.substr(1, end - 1))) {
+					return false;
+				}
+				expr.remove_prefix(end + 1);
+			} else {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void add_key(std::string_view name)
+	{
+		steps_.push_back({ string_t { name }, npos, Step::key });
+	}
+
+	// 'name', "name" or n
+	bool bracket(std::string_view s)
+	{
+		if (s.size() >= 2 && (s[0] == '\'' || s[0] == '"') &&
+		    s.back() == s[0]) {
+			add_key(s.substr(1, s.size() - 2));
+			return true;
+		}
+		auto pos = to_index(s);
+		if (pos == npos) {
+			return false;
+		}
+		steps_.push_back({ string_t { s }, pos, Step::index });
+		return true;
+	}
+};
+
+template<typename F>
+class PathExtractor;
+
+// paths merged by common prefix, result i belongs to the i-th added path
+class PathSet {
+	template<typename F>
+	friend class PathExtractor;
+
+public:
+	PathSet() : nodes_(1)
+	{
+	}
+
+	// return the result slot of p
+	size_t add(const Path &p)
+	{
+		uint32_t n = 0;
+		for (auto &s : p.steps()) {
+			n = child(n, s);
+		}
+		nodes_[n].ids.push_back(count_);
+		return count_++;
+	}
+
+	size_t size() const
+	{
+		return count_;
+	}
+
+	// out[i] is nullptr if the i-th path is missing
+	void find(JsonValue &root, std::vector<JsonValue *> &out) const
+	{
+		out.assign(count_, nullptr);
+		walk(0, root, [&out](size_t id, JsonValue &v) {
+			out[id] = &v;
+		});
+	}
+
+	// members of every object on the way are visited once, and a
+	// container is left as soon as all wanted children are seen
+	void find(ondemand::Value root, std::vector<ondemand::Value> &out) const
+	{
+		out.assign(count_, {});
+		walk(0, root, out);
+	}
+
+	void find(const ondemand::Document &doc,
+		  std::vector<ondemand::Value> &out) const
+	{
+		find(doc.root(), out);
+	}
+
+private:
+	struct Node {
+		std::vector<size_t> ids {};
+		std::vector<std::pair<Path::Step, uint32_t>> kids {};
+	};
+
+	std::vector<Node> nodes_;
+	size_t count_ = 0;
+
+	uint32_t child(uint32_t n, const Path::Step &s)
+	{
+		for (auto &[k, c] : nodes_[n].kids) {
+			if (k == s) {
+				return c;
+			}
+		}
+		auto c = static_cast<uint32_t>(nodes_.size());
+		nodes_[n].kids.emplace_back(s, c);
+		nodes_.emplace_back();
+		return c;
+	}
+
+	template<typename F>
+	void walk(uint32_t n, JsonValue &v, F &&f) const
+	{
+		for (auto id : nodes_[n].ids) {
+			f(id, v);
+		}
+		for (auto &[s, c] : nodes_[n].kids) {
+			if (auto x = Path::step(v, s)) {
+				walk(c, *x, f);
+			}
+		}
+	}
+
+	void walk(uint32_t n,
+		  ondemand::Value v,
+		  std::vector<ondemand::Value> &out) const
+	{
+		auto &node = nodes_[n];
+		for (auto id : node.ids) {
+			out[id] = v;
+		}
+		if (node.kids.empty()) {
+			return;
+		}
+		size_t want = 0;
+		size_t seen = 0;
+		if (v.is_object()) {
+			string_t buf; // keys of this level only
+			for (auto &[s, c] : node.kids) {
+				want += s.kind != Path::Step::index;
+			}
+			for (auto it = v.begin(); seen < want && it != v.end();
+			     ++it) {
+				auto k = it.key(buf);
+				if (!k) {
+					return;
+				}
+				for (auto &[s, c] : node.kids) {
+					if (s.match_key(*k)) {
+						++seen;
+						walk(c, *it, out);
+					}
+				}
+			}
+		} else if (v.is_array()) {
+			size_t last = 0;
+			for (auto &[s, c] : node.kids) {
+				if (s.kind != Path::Step::key &&
+				    s.pos != Path::npos) {
+					last = std::max(last, s.pos + 1);
+				}
+			}
+			size_t i = 0;
+			for (auto it = v.begin(); i < last && it != v.end();
+			     ++it, ++i) {
+				for (auto &[s, c] : node.kids) {
+					if (s.match_index(i)) {
+						walk(c, *it, out);
+					}
+				}
+			}
+		}
+	}
+};
+
+// SAX handler for StreamParser, only subtrees addressed by the PathSet are
+// built, for each top level value f(std::vector<JsonValue> &) is called with
+// one slot per path, a missing path is left invalid
+template<typename F>
+class PathExtractor : public SaxHandler {
+public:
+	PathExtractor(const PathSet &set, F f)
+		: set_ { set }, f_ { std::move(f) }, builder_ { Sink { this } }
+	{
+		out_.resize(set_.size());
+	}
+
+	PathExtractor(const PathExtractor &) = delete;
+	PathExtractor &operator=(const PathExtractor &) = delete;
+
+	void on_null()
+	{
+		scalar([this] { builder_.on_null(); });
+	}
+	void on_bool(bool_t b)
+	{
+		scalar([this, b] { builder_.on_bool(b); });
+	}
+	void on_number(number_t d)
+	{
+		scalar([this, d] { builder_.on_number(d); });
+	}
+	void on_integer(int_t n)
+	{
+		scalar([this, n] { builder_.on_integer(n); });
+	}
+	void on_unsigned(uint_t u)
+	{
+		scalar([this, u] { builder_.on_unsigned(u); });
+	}
+	void on_string(std::string_view s)
+	{
+		scalar([this, s] { builder_.on_string(s); });
+	}
+	void on_key(std::string_view k)
+	{
+		if (depth_) {
+			builder_.on_key(k);
+		} else if (frames_.back().node != none) {
+			frames_.back().key.assign(k);
+		}
+	}
+	void on_start_object()
+	{
+		open(true);
+	}
+	void on_start_array()
+	{
+		open(false);
+	}
+	void on_end_object()
+	{
+		close([this] { builder_.on_end_object(); });
+	}
+	void on_end_array()
+	{
+		close([this] { builder_.on_end_array(); });
+	}
+	void on_document_end()
+	{
+		f_(out_);
+		out_.assign(set_.size(), JsonValue {});
+	}
+
+private:
+	struct Sink {
+		PathExtractor *self;
+
+		void operator()(JsonValue &&v)
+		{
+			self->captured(std::move(v));
+		}
+	};
+
+	struct Frame {
+		uint32_t node;
+		bool object;
+		size_t index;
+		string_t key;
+	};
+
+	static constexpr uint32_t none = UINT32_MAX;
+
+	const PathSet &set_;
+	F f_;
+	ValueBuilder<Sink> builder_;
+	std::vector<Frame> frames_ {};
+	std::vector<JsonValue> out_ {};
+	std::vector<uint32_t> hits_ {};
+	size_t depth_ = 0; // nesting of the subtree being captured
+
+	// trie nodes the value that starts now belongs to
+	void locate()
+	{
+		hits_.clear();
+		if (frames_.empty()) {
+			hits_.push_back(0);
+			return;
+		}
+		auto &f = frames_.back();
+		if (f.node == none) {
+			return;
+		}
+		size_t i = f.object ? 0 : f.index++;
+		for (auto &[s, c] : set_.nodes_[f.node].kids) {
+			if (f.object ? s.match_key(f.key) : s.match_index(i)) {
+				hits_.push_back(c);
+			}
+		}
+	}
+
+	// a value is built as a whole if a path ends at it, or if paths fork
+	// at it, e.g. /0 and $[0] on the same array
+	bool capture() const
+	{
+		if (hits_.size() == 1) {
+			return !set_.nodes_[hits_[0]].ids.empty();
+		}
+		return !hits_.empty();
+	}
+
+	template<typename Fn>
+	void scalar(Fn &&fn)
+	{
+		if (!depth_) {
+			locate();
+			if (!capture()) {
+				return;
+			}
+		}
+		fn();
+	}
+
+	void open(bool object)
+	{
+		if (depth_) {
+			++depth_;
+		} else {
+			locate();
+			if (capture()) {
+				depth_ = 1;
+			} else {
+				auto n = hits_.empty() ? none : hits_[0];
+				frames_.push_back({ n, object, 0, {} });
+				return;
+			}
+		}
+		if (object) {
+			builder_.on_start_object();
+		} else {
+			builder_.on_start_array();
+		}
+	}
+
+	template<typename Fn>
+	void close(Fn &&fn)
+	{
+		if (depth_) {
+			--depth_;
+			fn();
+		} else {
+			frames_.pop_back();
+		}
+	}
+
+	// the captured nodes may have deeper paths too, they are looked up
+	// in the value just built
+	void captured(JsonValue &&v)
+	{
+		auto &node = set_.nodes_[hits_[0]];
+		if (hits_.size() == 1 && node.kids.empty() &&
+		    node.ids.size() == 1) {
+			out_[node.ids[0]] = std::move(v);
+			return;
+		}
+		for (auto n : hits_) {
+			set_.walk(n, v, [this](size_t id, JsonValue &x) {
+				out_[id] = x;
+			});
+		}
+	}
+};
+} // namespace nm::json
+
+#endif // JSON_POINTER_H_
@@ -0,0 +1,572 @@
+/***********************************************
+	File Name: stream.h
+	Author: Abby Cin
+	Mail: abbytsing@gmail.com
+	Created Time: 10/18/26 3:05 PM
+***********************************************/
+
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include "json.h"
+
+// push style parser for chunked input, chunks are fed as they arrive and SAX
+// events are fired as soon as a token is complete, any number of top level
+// values separated by whitespace are accepted, so NDJSON works as is
+//
+// memory is bounded by max_depth and the longest single token, a token cut by
+// a chunk boundary is the only thing copied, the caller may drop a chunk as
+// soon as feed returns, e.g. with a loop_per_thread session buffer:
+//
+//	parser.feed(buf_.data());
+//	buf_.consume(buf_.size());
+namespace nm::json
+{
+// handlers may derive from this and hide only the events they care about,
+// string views are valid until the callback returns, a handler may also add
+// on_integer(int_t) and on_unsigned(uint_t) to get exact integers
+struct SaxHandler {
+	void on_null()
+	{
+	}
+	void on_bool(bool_t)
+	{
+	}
+	void on_number(number_t)
+	{
+	}
+	void on_string(std::string_view)
+	{
+	}
+	void on_key(std::string_view)
+	{
+	}
+	void on_start_object()
+	{
+	}
+	void on_end_object()
+	{
+	}
+	void on_start_array()
+	{
+	}
+	void on_end_array()
+	{
+	}
+	// a top level value is complete
+	void on_document_end()
+	{
+	}
+};
+
+template<typename Handler>
+class StreamParser {
+public:
+	explicit StreamParser(Handler &h, size_t max_token = 1 << 24)
+		: h_ { h }, max_token_ { max_token }
+	{
+		stack_.reserve(max_depth + 1);
+	}
+
+	// false once the stream is malformed, see trace()
+	bool feed(std::string_view in)
+	{
+		size_t i = 0;
+		while (ok() && i < in.size()) {
+			switch (state_) {
+			case State::string:
+			case State::key:
+				i = scan_string(in, i);
+				break;
+			case State::scalar:
+				i = scan_scalar(in, i);
+				break;
+			default:
+				i = step(in, i);
+				break;
+			}
+		}
+		offset_ += in.size();
+		return ok();
+	}
+
+	// anything with data() and size(), such as std::string, std::vector
+	// or an asio buffer
+	template<typename Buffer>
+		requires requires(const Buffer &b) {
+			b.data();
+			b.size();
+		}
+	bool feed(const Buffer &b)
+	{
+		return feed(std::string_view {
+			static_cast<const char *>(b.data()), b.size() });
+	}
+
+	// end of stream, flush a pending top level scalar
+	bool finish()
+	{
+		if (ok() && state_ == State::scalar) {
+			flush_scalar({}, 0);
+		}
+		if (ok() && (state_ != State::value || !stack_.empty())) {
+			fail(0, "unexpected end of stream");
+		}
+		return ok();
+	}
+
+	// start over after an error or between streams
+	void reset()
+	{
+		stack_.clear();
+		token_.clear();
+		trace_.clear();
+		state_ = State::value;
+		offset_ = 0;
+		escaped_ = false;
+		has_escape_ = false;
+	}
+
+	[[nodiscard]] bool ok() const
+	{
+		return trace_.empty();
+	}
+
+	[[nodiscard]] const std::string &trace() const
+	{
+		return trace_;
+	}
+
+private:
+	enum class State : uint8_t {
+		value,		 // any value
+		value_or_end,	 // after '['
+		key_or_end,	 // after '{'
+		key_start,	 // after ',' in an object
+		colon,		 // after a key
+		after,		 // after a value in a container
+		string,		 // inside a string value
+		key,		 // inside a key
+		scalar,		 // inside a number or literal
+	};
+
+	Handler &h_;
+	size_t max_token_;
+	std::vector<char> stack_ {};
+	std::string token_ {};
+	std::string decoded_ {};
+	std::string trace_ {};
+	State state_ { State::value };
+	size_t offset_ = 0;
+	bool escaped_ = false;	  // chunk ended right after a backslash
+	bool has_escape_ = false; // current string needs decoding
+
+	static bool is_ws(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	void fail(size_t i, const char *what)
+	{
+		trace_ = "offset: " + std::to_string(offset_ + i) + ", " + what;
+	}
+
+	bool append(std::string_view s, size_t i)
+	{
+		if (token_.size() + s.size() > max_token_) {
+			fail(i, "token too long");
+			return false;
+		}
+		token_.append(s);
+		return true;
+	}
+
+	void end_value()
+	{
+		if (stack_.empty()) {
+			h_.on_document_end();
+			state_ = State::value;
+		} else {
+			state_ = State::after;
+		}
+	}
+
+	// a structural or the start of a token at in[i]
+	size_t step(std::string_view in, size_t i)
+	{
+		char c = in[i];
+		if (is_ws(c)) {
+			return i + 1;
+		}
+		switch (state_) {
+		case State::value_or_end:
+			if (c == ']') {
+				return close(i, '[');
+			}
+			[[fallthrough]];
+		case State::value:
+			return start_value(in, i);
+		case State::key_or_end:
+			if (c == '}') {
+				return close(i, '{');
+			}
+			[[fallthrough]];
+		case State::key_start:
+			if (c != '"') {
+				break;
+			}
+			start_string(State::key);
+			return i + 1;
+		case State::colon:
+			if (c != ':') {
+				break;
+			}
+			state_ = State::value;
+			return i + 1;
+		case State::after:
+			if (c == ',') {
+				state_ = stack_.back() == '{' ? State::key_start
+							      : State::value;
+				return i + 1;
+			}
+			if (c == '}' || c == ']') {
+				return close(i, c == '}' ? '{' : '[');
+			}
+			break;
+		default:
+			break;
+		}
+		fail(i, "invalid token");
+		return i;
+	}
+
+	size_t close(size_t i, char open)
+	{
+		if (stack_.empty() || stack_.back() != open) {
+			fail(i, "invalid token");
+			return i;
+		}
+		stack_.pop_back();
+		if (open == '{') {
+			h_.on_end_object();
+		} else {
+			h_.on_end_array();
+		}
+		end_value();
+		return i + 1;
+	}
+
+	size_t start_value(std::string_view in, size_t i)
+	{
+		if (detail::too_deep(stack_.size())) {
+			fail(i, "nested too deeply");
+			return i;
+		}
+		switch (in[i]) {
+		case '{':
+			stack_.push_back('{');
+			h_.on_start_object();
+			state_ = State::key_or_end;
+			return i + 1;
+		case '[':
+			stack_.push_back('[');
+			h_.on_start_array();
+			state_ = State::value_or_end;
+			return i + 1;
+		case '"':
+			start_string(State::string);
+			return i + 1;
+		case ',':
+		case ':':
+		case ']':
+		case '}':
+			fail(i, "invalid token");
+			return i;
+		default:
+			token_.clear();
+			state_ = State::scalar;
+			return i;
+		}
+	}
+
+	void start_string(State s)
+	{
+		token_.assign(1, '"');
+		has_escape_ = false;
+		escaped_ = false;
+		state_ = s;
+	}
+
+	// first '"' or '\\' in [i, in.size()), in.size() if none
+	static size_t find_quote(std::string_view in, size_t i)
+	{
+		auto q = _mm_set1_epi8('"');
+		auto bs = _mm_set1_epi8('\\');
+		for (; i + 16 <= in.size(); i += 16) {
+			auto v = _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>(in.data() +
+								  i));
+			auto m = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)));
+			if (m) {
+				return i + __builtin_ctz(m);
+			}
+		}
+		while (i < in.size() && in[i] != '"' && in[i] != '\\') {
+			++i;
+		}
+		return i;
+	}
+
+	// strings that start and end in one chunk are not copied
+	size_t scan_string(std::string_view in, size_t i)
+	{
+		size_t b = i;
+		if (escaped_) {
+			escaped_ = false;
+			++i;
+		}
+		while (true) {
+			auto q = find_quote(in, i);
+			if (q == in.size()) {
+				append(in.substr(b), i);
+				return in.size();
+			}
+			if (in[q] == '\\') {
+				has_escape_ = true;
+				if (q + 1 == in.size()) {
+					escaped_ = true;
+					append(in.substr(b), q);
+					return in.size();
+				}
+				i = q + 2;
+				continue;
+			}
+			std::string_view raw;
+			if (token_.size() == 1 && b > 0) {
+				raw = in.substr(b - 1, q - b + 2);
+			} else if (append(in.substr(b, q - b + 1), q)) {
+				raw = token_;
+			} else {
+				return q;
+			}
+			emit_string(raw, q);
+			return q + 1;
+		}
+	}
+
+	// raw is the string with both quotes
+	void emit_string(std::string_view raw, size_t i)
+	{
+		auto s = raw.substr(1, raw.size() - 2);
+		if (has_escape_) {
+			decoded_.clear();
+			if (!detail::Scanner { raw }.read_string(0, decoded_)) {
+				fail(i, "invalid escape");
+				return;
+			}
+			s = decoded_;
+		}
+		if (state_ == State::key) {
+			h_.on_key(s);
+			state_ = State::colon;
+		} else {
+			h_.on_string(s);
+			end_value();
+		}
+	}
+
+	size_t scan_scalar(std::string_view in, size_t i)
+	{
+		size_t b = i;
+		while (i < in.size() && !detail::Scanner::is_delim(in[i])) {
+			++i;
+		}
+		if (i == in.size()) {
+			append(in.substr(b), i);
+			return i;
+		}
+		flush_scalar(in.substr(b, i - b), i);
+		return i;
+	}
+
+	// handlers without on_integer or on_unsigned get integers through
+	// on_number
+	void on_integer(int_t n)
+	{
+		if constexpr (requires { h_.on_integer(n); }) {
+			h_.on_integer(n);
+		} else {
+			h_.on_number(static_cast<number_t>(n));
+		}
+	}
+
+	void on_unsigned(uint_t u)
+	{
+		if constexpr (requires { h_.on_unsigned(u); }) {
+			h_.on_unsigned(u);
+		} else {
+			h_.on_number(static_cast<number_t>(u));
+		}
+	}
+
+	// a scalar is only known to end at the next delimiter
+	void flush_scalar(std::string_view tail, size_t i)
+	{
+		std::string_view s = tail;
+		if (!token_.empty()) {
+			if (!append(tail, i)) {
+				return;
+			}
+			s = token_;
+		}
+		detail::Scanner sc { s };
+		number_t d;
+		int_t n;
+		uint_t u;
+		if (sc.match(0, "true")) {
+			h_.on_bool(true);
+		} else if (sc.match(0, "false")) {
+			h_.on_bool(false);
+		} else if (sc.match(0, "null")) {
+			h_.on_null();
+		} else {
+			switch (sc.scan_number(0, n, u)) {
+			case detail::Scanner::integer:
+				on_integer(n);
+				break;
+			case detail::Scanner::uinteger:
+				on_unsigned(u);
+				break;
+			case detail::Scanner::real:
+				if (sc.read_real(0, d)) {
+					h_.on_number(d);
+					break;
+				}
+				[[fallthrough]];
+			default:
+				fail(i, "invalid token");
+				return;
+			}
+		}
+		token_.clear();
+		end_value();
+	}
+};
+
+// builds a JsonValue for each top level value and hands it to f as soon as it
+// is complete, memory is bounded by the largest single value
+template<typename F>
+class ValueBuilder : public SaxHandler {
+public:
+	explicit ValueBuilder(F f) : f_ { std::move(f) }
+	{
+	}
+
+	void on_null()
+	{
+		add(null_t {});
+	}
+	void on_bool(bool_t b)
+	{
+		add(b);
+	}
+	void on_number(number_t d)
+	{
+		add(d);
+	}
+	void on_integer(int_t n)
+	{
+		add(n);
+	}
+	void on_unsigned(uint_t u)
+	{
+		add(u);
+	}
+	void on_string(std::string_view s)
+	{
+		add(string_t { s });
+	}
+	void on_key(std::string_view k)
+	{
+		keys_.emplace_back(k);
+	}
+	void on_start_object()
+	{
+		stack_.emplace_back(object_t {});
+	}
+	void on_start_array()
+	{
+		stack_.emplace_back(array_t {});
+	}
+	void on_end_object()
+	{
+		pop();
+	}
+	void on_end_array()
+	{
+		pop();
+	}
+
+private:
+	F f_;
+	std::vector<JsonValue> stack_ {};
+	std::vector<string_t> keys_ {};
+
+	void pop()
+	{
+		auto v = std::move(stack_.back());
+		stack_.pop_back();
+		add(std::move(v));
+	}
+
+	void add(JsonValue &&v)
+	{
+		if (stack_.empty()) {
+			f_(std::move(v));
+		} else if (stack_.back().is_array()) {
+			stack_.back().get<array_t>().push_back(std::move(v));
+		} else {
+			// first of duplicate keys wins, as in parse()
+			stack_.back().get<object_t>().emplace(
+				std::move(keys_.back()), std::move(v));
+			keys_.pop_back();
+		}
+	}
+};
+
+// feed chunks, receive complete JsonValues, e.g. one per NDJSON line
+template<typename F>
+class ValueStream {
+public:
+	explicit ValueStream(F f, size_t max_token = 1 << 24)
+		: builder_ { std::move(f) }, parser_ { builder_, max_token }
+	{
+	}
+
+	ValueStream(const ValueStream &) = delete;
+	ValueStream &operator=(const ValueStream &) = delete;
+
+	template<typename Buffer>
+	bool feed(const Buffer &b)
+	{
+		return parser_.feed(b);
+	}
+
+	bool finish()
+	{
+		return parser_.finish();
+	}
+
+	[[nodiscard]] const std::string &trace() const
+	{
+		return parser_.trace();
+	}
+
+private:
+	ValueBuilder<F> builder_;
+	StreamParser<ValueBuilder<F>> parser_;
+};
+} // namespace nm::json
+
+#endif // JSON_STREAM_H_
@@ -0,0 +1,409 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Author: Abby Cin
+ * Mail: abbytsing@gmail.com
+ * Create Time: 2026-10-18 10:12:40
+ */
+
+// side by side numbers of nm::SwissMap, nm::hash::HashTable (cfg/hash.h) and
+// std::unordered_map
+//
+// usage: swiss_bench [--sizes 1000,100000,...] [--lf 0.5,0.75,...]
+//                    [--keys int,short,long] [--json]
+//
+// every table runs insert, find_hit, find_miss, erase_churn and iterate for
+// each key kind, size and max load factor, one record per operation is
+// printed as CSV (default) or JSON lines
+// NOTE: HashTable only takes std::string, integer keys are stringified for it,
+// it has no load factor knob nor iteration, so it runs once per size with its
+// fixed load factor 1.0 and skips iterate
+
+#include "swiss_map.h"
+#include <cfg/hash.h>
+#include <instant/instant.h>
+#include <algorithm>
+#include <cstring>
+#include <malloc.h>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+struct Record {
+	std::string table;
+	std::string key;
+	uint64_t size;
+	double lf;
+	std::string op;
+	double ns;
+	double bytes;
+	std::string hist;
+};
+
+struct Options {
+	std::vector<uint64_t> sizes { 1000, 100000, 1000000 };
+	std::vector<double> lfs { 0.5, 0.75, 0.875 };
+	std::vector<std::string> keys { "int", "short", "long" };
+	bool json = false;
+};
+
+uint64_t heap_bytes()
+{
+	auto mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+// the first n keys are inserted, the next n are used for misses and churn
+template<typename K>
+std::vector<K> make_keys(const std::string &kind, uint64_t n)
+{
+	std::vector<K> v {};
+
+	v.reserve(2 * n);
+	for (uint64_t i = 0; i < 2 * n; ++i) {
+		auto x = mix(i);
+		if constexpr (std::is_integral_v<K>) {
+			v.push_back(x);
+		} else {
+			auto s = std::to_string(x % 100000000000000);
+			if (kind == "long")
+				s = "tenant/region/service/instance/" + s +
+				    "/metric";
+			v.push_back(s);
+		}
+	}
+	return v;
+}
+
+std::string hist_str(const std::map<uint64_t, uint64_t> &h, uint64_t total)
+{
+	std::ostringstream os {};
+	bool first = true;
+
+	for (auto [len, cnt] : h) {
+		if (!first)
+			os << '|';
+		first = false;
+		os << len << '=' << static_cast<double>(cnt) / total;
+	}
+	return os.str();
+}
+
+template<typename K>
+struct SwissBench {
+	static constexpr const char *name = "swiss";
+	using key_type = K;
+	nm::SwissMap<K, uint64_t> m {};
+
+	explicit SwissBench(double lf)
+	{
+		m.set_max_load_factor(lf);
+	}
+
+	void insert(const K &k, uint64_t v)
+	{
+		m.emplace(k, v);
+	}
+
+	bool find(const K &k)
+	{
+		return m.contains(k);
+	}
+
+	void erase(const K &k)
+	{
+		m.erase(k);
+	}
+
+	uint64_t iterate()
+	{
+		uint64_t sum = 0;
+		for (auto &[k, v] : m)
+			sum += v;
+		return sum;
+	}
+
+	// groups probed per successful lookup
+	uint64_t probe(const K &k)
+	{
+		return m.probe_length(k);
+	}
+};
+
+template<typename K>
+struct StdBench {
+	static constexpr const char *name = "std";
+	using key_type = K;
+	std::unordered_map<K, uint64_t> m {};
+
+	explicit StdBench(double lf)
+	{
+		m.max_load_factor(lf);
+	}
+
+	void insert(const K &k, uint64_t v)
+	{
+		m.emplace(k, v);
+	}
+
+	bool find(const K &k)
+	{
+		return m.find(k) != m.end();
+	}
+
+	void erase(const K &k)
+	{
+		m.erase(k);
+	}
+
+	uint64_t iterate()
+	{
+		uint64_t sum = 0;
+		for (auto &[k, v] : m)
+			sum += v;
+		return sum;
+	}
+
+	// length of the bucket chain holding the key
+	uint64_t probe(const K &k)
+	{
+		return m.bucket_size(m.bucket(k));
+	}
+};
+
+struct CfgBench {
+	static constexpr const char *name = "cfg";
+	using key_type = std::string;
+	nm::hash::HashTable m {};
+
+	explicit CfgBench(double)
+	{
+	}
+
+	void insert(const std::string &k, uint64_t)
+	{
+		m.insert(k, {});
+	}
+
+	bool find(const std::string &k)
+	{
+		return m.search(k).is_valid();
+	}
+
+	void erase(const std::string &k)
+	{
+		m.remove(k, nm::hash::murmurhash2(k.data(), k.size(), 0));
+	}
+
+	uint64_t iterate()
+	{
+		return 0;
+	}
+
+	uint64_t probe(const std::string &)
+	{
+		return 0;
+	}
+};
+
+template<typename F>
+double ns_per_op(uint64_t ops, F &&f)
+{
+	auto b = nm::Instant::now();
+	f();
+	return b.elapse_usec() * 1e3 / ops;
+}
+
+template<typename Table>
+void run(const std::string &kind,
+	 const std::vector<typename Table::key_type> &keys,
+	 uint64_t n,
+	 double lf,
+	 std::vector<Record> &out)
+{
+	constexpr bool is_cfg = std::is_same_v<Table, CfgBench>;
+	volatile uint64_t junk = 0;
+	std::vector<uint64_t> order(n);
+	auto emit = [&](const char *op, double ns, double bytes, auto hist) {
+		out.push_back({ Table::name,
+				kind,
+				n,
+				is_cfg ? 1.0 : lf,
+				op,
+				ns,
+				bytes,
+				hist });
+	};
+
+	for (uint64_t i = 0; i < n; ++i)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), std::mt19937_64 { n });
+
+	auto before = heap_bytes();
+	auto t = new Table { lf };
+	auto ns = ns_per_op(n, [&] {
+		for (uint64_t i = 0; i < n; ++i)
+			t->insert(keys[i], i);
+	});
+	double bytes = static_cast<double>(heap_bytes() - before) / n;
+	emit("insert", ns, bytes, "");
+
+	ns = ns_per_op(n, [&] {
+		for (auto i : order)
+			junk = junk + t->find(keys[i]);
+	});
+	std::string hist {};
+	if constexpr (!is_cfg) {
+		std::map<uint64_t, uint64_t> h {};
+		for (uint64_t i = 0; i < n; ++i)
+			h[std::min<uint64_t>(t->probe(keys[i]), 8)] += 1;
+		hist = hist_str(h, n);
+	}
+	emit("find_hit", ns, bytes, hist);
+
+	ns = ns_per_op(n, [&] {
+		for (uint64_t i = n; i < 2 * n; ++i)
+			junk = junk + t->find(keys[i]);
+	});
+	emit("find_miss", ns, bytes, "");
+
+	// erase an old key and insert a new one, size stays at n
+	ns = ns_per_op(2 * n, [&] {
+		for (uint64_t i = 0; i < n; ++i) {
+			t->erase(keys[order[i]]);
+			t->insert(keys[n + i], i);
+		}
+	});
+	emit("erase_churn", ns, bytes, "");
+
+	if constexpr (!is_cfg) {
+		ns = ns_per_op(n, [&] { junk = junk + t->iterate(); });
+		emit("iterate", ns, bytes, "");
+	}
+	delete t;
+}
+
+template<typename K>
+void run_all(const std::string &kind,
+	     uint64_t n,
+	     const Options &opt,
+	     std::vector<Record> &out)
+{
+	auto keys = make_keys<K>(kind, n);
+
+	for (auto lf : opt.lfs) {
+		run<SwissBench<K>>(kind, keys, n, lf, out);
+		run<StdBench<K>>(kind, keys, n, lf, out);
+	}
+
+	if constexpr (std::is_same_v<K, std::string>) {
+		run<CfgBench>(kind, keys, n, 1.0, out);
+	} else {
+		std::vector<std::string> skeys {};
+		skeys.reserve(keys.size());
+		for (auto k : keys)
+			skeys.push_back(std::to_string(k));
+		run<CfgBench>(kind, skeys, n, 1.0, out);
+	}
+}
+
+template<typename T, typename F>
+std::vector<T> split(const char *s, F &&conv)
+{
+	std::vector<T> v {};
+	std::istringstream is { s };
+	std::string item {};
+
+	while (std::getline(is, item, ','))
+		v.push_back(conv(item));
+	return v;
+}
+
+Options parse(int argc, char *argv[])
+{
+	Options opt {};
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--json") == 0) {
+			opt.json = true;
+		} else if (i + 1 < argc && strcmp(argv[i], "--sizes") == 0) {
+			opt.sizes = split<uint64_t>(argv[++i], [](auto &s) {
+				return std::stoull(s);
+			});
+		} else if (i + 1 < argc && strcmp(argv[i], "--lf") == 0) {
+			opt.lfs = split<double>(argv[++i], [](auto &s) {
+				return std::stod(s);
+			});
+		} else if (i + 1 < argc && strcmp(argv[i], "--keys") == 0) {
+			opt.keys = split<std::string>(argv[++i],
+						      [](auto &s) { return s; });
+		} else {
+			fprintf(stderr,
+				"usage: %s [--sizes n,...] [--lf x,...] "
+				"[--keys int,short,long] [--json]\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	return opt;
+}
+
+void print(const Record &r, bool json)
+{
+	if (json)
+		printf("{\"table\":\"%s\",\"key\":\"%s\",\"size\":%lu,"
+		       "\"lf\":%.3f,\"op\":\"%s\",\"ns_per_op\":%.2f,"
+		       "\"bytes_per_entry\":%.2f,\"probe_hist\":\"%s\"}\n",
+		       r.table.c_str(),
+		       r.key.c_str(),
+		       r.size,
+		       r.lf,
+		       r.op.c_str(),
+		       r.ns,
+		       r.bytes,
+		       r.hist.c_str());
+	else
+		printf("%s,%s,%lu,%.3f,%s,%.2f,%.2f,%s\n",
+		       r.table.c_str(),
+		       r.key.c_str(),
+		       r.size,
+		       r.lf,
+		       r.op.c_str(),
+		       r.ns,
+		       r.bytes,
+		       r.hist.c_str());
+}
+}
+
+int main(int argc, char *argv[])
+{
+	auto opt = parse(argc, argv);
+
+	if (!opt.json)
+		printf("table,key,size,lf,op,ns_per_op,bytes_per_entry,"
+		       "probe_hist\n");
+	for (auto n : opt.sizes) {
+		for (auto &kind : opt.keys) {
+			std::vector<Record> out {};
+			if (kind == "int")
+				run_all<uint64_t>(kind, n, opt, out);
+			else
+				run_all<std::string>(kind, n, opt, out);
+			for (auto &r : out)
+				print(r, opt.json);
+			fflush(stdout);
+		}
+	}
+}
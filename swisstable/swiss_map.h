@@ -9,29 +9,114 @@
 #define SWISS_MAP_H_20231016132304
 
 #include "swisstable.h"
+#include <fcntl.h>
 #include <initializer_list>
+#include <optional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace nm
 {
+namespace detail
+{
+	template<typename K, typename V, template<typename> class Slot>
+	class BasicMapPolicy
+		: public Slot<std::pair<std::remove_cvref_t<K>, V>> {
+		using Base = Slot<std::pair<std::remove_cvref_t<K>, V>>;
+
+	public:
+		static_assert(!std::is_reference_v<K>,
+			      "forbid reference as key");
+		using key_type = std::remove_cvref_t<K>;
+		using value_type = std::pair<key_type, V>;
+		using typename Base::slot_type;
+
+		static const key_type &key(const value_type &v)
+		{
+			return v.first;
+		}
+
+		static const key_type &slot_key(const slot_type &s)
+		{
+			return Base::get(s).first;
+		}
+	};
+}
+
+// pairs are stored in the slot array
+template<typename K, typename V>
+using MapPolicy = detail::BasicMapPolicy<K, V, detail::flat_slot>;
+
+// slot array holds pointers to heap allocated pairs, references are stable
+// and probing touches 8 bytes per slot, good for large values
 template<typename K, typename V>
-class MapPolicy {
+using NodeMapPolicy = detail::BasicMapPolicy<K, V, detail::node_slot>;
+
+// keys are stored in the slot array and values in a parallel array, so that
+// probing only pulls keys into cache, good for small keys with larger values
+// NOTE: iterator yields std::pair<const K &, V &> by value
+template<typename K, typename V>
+class SplitMapPolicy {
 public:
 	static_assert(!std::is_reference_v<K>, "forbid reference as key");
 	using key_type = std::remove_cvref_t<K>;
 	using value_type = std::pair<key_type, V>;
+	using slot_type = key_type;
+	using mapped_type = V;
+	using reference = std::pair<const key_type &, V &>;
+	using pointer = detail::arrow<reference>;
 
 	static const key_type &key(const value_type &v)
 	{
 		return v.first;
 	}
+
+	static const key_type &slot_key(const slot_type &s)
+	{
+		return s;
+	}
+
+	static reference element(slot_type *s, mapped_type *m)
+	{
+		return { *s, *m };
+	}
+
+	static pointer address(slot_type *s, mapped_type *m)
+	{
+		return { element(s, m) };
+	}
+
+	static void construct(slot_type *s, mapped_type *m, value_type &&v)
+	{
+		std::construct_at(s, std::move(v.first));
+		std::construct_at(m, std::move(v.second));
+	}
+
+	static void destroy(slot_type *s, mapped_type *m)
+	{
+		std::destroy_at(s);
+		std::destroy_at(m);
+	}
+
+	static void transfer(slot_type *dst,
+			     mapped_type *dm,
+			     slot_type *src,
+			     mapped_type *sm)
+	{
+		std::construct_at(dst, std::move(*src));
+		std::construct_at(dm, std::move(*sm));
+		destroy(src, sm);
+	}
 };
 
 template<typename Key,
 	 typename Val,
 	 typename Hash = SwissHash,
-	 typename Eq = SwissEq>
-class SwissMap : public detail::Swiss<MapPolicy<Key, Val>, Hash, Eq> {
-	using Base = detail::Swiss<MapPolicy<Key, Val>, Hash, Eq>;
+	 typename Eq = SwissEq,
+	 template<typename, typename> class Layout = MapPolicy>
+class SwissMap : public detail::Swiss<Layout<Key, Val>, Hash, Eq> {
+	using Base = detail::Swiss<Layout<Key, Val>, Hash, Eq>;
 
 public:
 	using Base::Base;
@@ -42,6 +127,8 @@ public:
 	using Base::erase;
 	using Base::reserve;
 	using Base::find;
+	using Base::find_batch;
+	using Base::save;
 	using iterator = Base::iterator;
 
 	SwissMap(std::initializer_list<typename Base::value_type> il) : Base {}
@@ -58,6 +145,104 @@ public:
 		return it->second;
 	}
 };
+
+// read-only map over a file written by SwissMap::save, the table is mmap'ed
+// as is and probed by the same code, so open is O(1) and the pages are
+// shared among processes mapping the same file
+// NOTE: the mapping is read-only, writing through iterators will fault
+template<typename Key,
+	 typename Val,
+	 typename Hash = SwissHash,
+	 typename Eq = SwissEq,
+	 template<typename, typename> class Layout = MapPolicy>
+class FrozenSwissMap : detail::Swiss<Layout<Key, Val>, Hash, Eq> {
+	using Base = detail::Swiss<Layout<Key, Val>, Hash, Eq>;
+
+public:
+	using Base::begin;
+	using Base::end;
+	using Base::find;
+	using Base::find_batch;
+	using Base::contains;
+	using Base::size;
+	using Base::cap;
+	using Base::load_factor;
+	using iterator = Base::iterator;
+
+	FrozenSwissMap(FrozenSwissMap &&rhs) noexcept : Base {}
+	{
+		*this = std::move(rhs);
+	}
+
+	FrozenSwissMap &operator=(FrozenSwissMap &&rhs) noexcept
+	{
+		if (this != &rhs) {
+			Base::operator=(std::move(rhs));
+			std::swap(addr_, rhs.addr_);
+			std::swap(len_, rhs.len_);
+		}
+		return *this;
+	}
+
+	~FrozenSwissMap()
+	{
+		if (addr_) {
+			Base::detach();
+			munmap(addr_, len_);
+		}
+	}
+
+	static std::optional<FrozenSwissMap> open(const char *path)
+	{
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return std::nullopt;
+
+		struct stat st;
+		void *addr = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+			addr = mmap(nullptr,
+				    st.st_size,
+				    PROT_READ,
+				    MAP_SHARED,
+				    fd,
+				    0);
+		close(fd);
+		if (addr == MAP_FAILED)
+			return std::nullopt;
+
+		using header = detail::snapshot_header;
+		std::optional<FrozenSwissMap> m { FrozenSwissMap {} };
+		auto h = reinterpret_cast<const header *>(addr);
+		if (!m->attach(h, st.st_size)) {
+			munmap(addr, st.st_size);
+			return std::nullopt;
+		}
+		m->addr_ = addr;
+		m->len_ = st.st_size;
+		return m;
+	}
+
+private:
+	FrozenSwissMap() : Base {}
+	{
+	}
+
+	void *addr_ = nullptr;
+	uint64_t len_ = 0;
+};
+
+template<typename Key,
+	 typename Val,
+	 typename Hash = SwissHash,
+	 typename Eq = SwissEq>
+using NodeSwissMap = SwissMap<Key, Val, Hash, Eq, NodeMapPolicy>;
+
+template<typename Key,
+	 typename Val,
+	 typename Hash = SwissHash,
+	 typename Eq = SwissEq>
+using SplitSwissMap = SwissMap<Key, Val, Hash, Eq, SplitMapPolicy>;
 }
 
 #endif // SWISS_MAP_H_20231016132304
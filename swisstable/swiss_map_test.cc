@@ -6,6 +6,78 @@
  */
 
 #include "swiss_map.h"
+#include <cstdio>
+#include <string>
+
+template<typename Map>
+void layout(const char *name)
+{
+	using namespace std::string_literals;
+	Map m { { 1, "one"s } };
+
+	m.emplace(2, "two"s);
+	m.insert({ 3, "three"s });
+	m[4] = "four";
+
+	auto &ref = m[4];
+	m.reserve(m.cap() * 4);
+	printf("%s: m[4] %s after rehash\n",
+	       name,
+	       &ref == &m[4] ? "stable" : "moved");
+
+	m.erase(2);
+	for (auto &&[k, v] : m)
+		printf("%s: %d => %s\n", name, k, v.c_str());
+}
+
+void frozen()
+{
+	const char *path = "swiss_map.snap";
+	nm::SwissMap<int, double> m {};
+
+	for (int i = 0; i < 1000; ++i)
+		m.emplace(i, i / 2.0);
+	m.erase(7);
+	if (!m.save(path)) {
+		printf("save %s failed\n", path);
+		return;
+	}
+
+	auto f = nm::FrozenSwissMap<int, double>::open(path);
+	if (!f) {
+		printf("open %s failed\n", path);
+		return;
+	}
+	printf("frozen size %lu, 7 %s, 9 => %f\n",
+	       f->size(),
+	       f->contains(7) ? "found" : "not found",
+	       f->find(9)->second);
+	std::remove(path);
+}
+
+// max load factor and incremental resize must survive growth
+void settings()
+{
+	nm::SwissMap<int, int> m {};
+
+	m.set_max_load_factor(0.5);
+	for (int i = 0; i < 1000; ++i)
+		m.emplace(i, i);
+	printf("max_load_factor %f after %lu inserts, load_factor %f\n",
+	       m.max_load_factor(),
+	       m.size(),
+	       m.load_factor());
+
+	m.set_incremental_resize(1);
+	m.reserve(m.cap() * 4);
+	bool resizing = false;
+	for (int i = 1000; i < 100000 && !resizing; ++i) {
+		m.emplace(i, i);
+		resizing = m.resizing();
+	}
+	printf("incremental resize %s after reserve\n",
+	       resizing ? "kept" : "lost");
+}
 
 int main()
 {
@@ -56,4 +128,11 @@ int main()
 		for (auto &[k, v] : m)
 			printf("%s => %d\n", k.c_str(), v);
 	}
+
+	layout<nm::SwissMap<int, std::string>>("flat");
+	layout<nm::NodeSwissMap<int, std::string>>("node");
+	layout<nm::SplitSwissMap<int, std::string>>("split");
+
+	frozen();
+	settings();
 }
\ No newline at end of file
@@ -13,23 +13,46 @@
 
 namespace nm
 {
+namespace detail
+{
+	template<typename T, template<typename> class Slot>
+	class BasicSetPolicy : public Slot<std::remove_cvref_t<T>> {
+		using Base = Slot<std::remove_cvref_t<T>>;
+
+	public:
+		static_assert(!std::is_reference_v<T>,
+			      "forbid reference as key");
+		using key_type = std::remove_cvref_t<T>;
+		using value_type = std::remove_cvref_t<T>;
+		using typename Base::slot_type;
+
+		static const key_type &key(const value_type &v)
+		{
+			static_assert(std::is_same_v<key_type, value_type>);
+			return v;
+		}
+
+		static const key_type &slot_key(const slot_type &s)
+		{
+			return Base::get(s);
+		}
+	};
+}
+
+// values are stored in the slot array
 template<typename T>
-class SetPolicy {
-public:
-	static_assert(!std::is_reference_v<T>, "forbid reference as key");
-	using key_type = std::remove_cvref_t<T>;
-	using value_type = std::remove_cvref_t<T>;
+using SetPolicy = detail::BasicSetPolicy<T, detail::flat_slot>;
 
-	static const key_type &key(const value_type &v)
-	{
-		static_assert(std::is_same_v<key_type, value_type>);
-		return v;
-	}
-};
+// slot array holds pointers to heap allocated values, references are stable
+template<typename T>
+using NodeSetPolicy = detail::BasicSetPolicy<T, detail::node_slot>;
 
-template<typename Key, typename Hash = SwissHash, typename Eq = SwissEq>
-class SwissSet : public detail::Swiss<SetPolicy<Key>, Hash, Eq> {
-	using Base = detail::Swiss<SetPolicy<Key>, Hash, Eq>;
+template<typename Key,
+	 typename Hash = SwissHash,
+	 typename Eq = SwissEq,
+	 template<typename> class Layout = SetPolicy>
+class SwissSet : public detail::Swiss<Layout<Key>, Hash, Eq> {
+	using Base = detail::Swiss<Layout<Key>, Hash, Eq>;
 
 public:
 	using Base::Base;
@@ -40,6 +63,7 @@ public:
 	using Base::erase;
 	using Base::reserve;
 	using Base::find;
+	using Base::find_batch;
 	using iterator = Base::iterator;
 
 	SwissSet(std::initializer_list<typename Base::value_type> il) : Base {}
@@ -48,6 +72,9 @@ public:
 			insert(x);
 	}
 };
+
+template<typename Key, typename Hash = SwissHash, typename Eq = SwissEq>
+using NodeSwissSet = SwissSet<Key, Hash, Eq, NodeSetPolicy>;
 }
 
 #endif // SWISS_SET_20231017111116
@@ -7,6 +7,7 @@
 
 #include "swiss_set.h"
 #include <instant/instant.h>
+#include <algorithm>
 #include <random>
 #include <unordered_set>
 #include <vector>
@@ -45,7 +46,7 @@ void bench(std::vector<T> &v, Set &s, bool ins)
 			s.insert(x);
 	else
 		for (auto &x : v)
-			junk += s.contains(x);
+			junk = junk + s.contains(x);
 	auto ms = b.elapse_ms();
 	if constexpr (std::is_same_v<nm::SwissSet<T, H>, Set>)
 		printf("%20s => %6fms\n", "swiss", ms);
@@ -53,6 +54,21 @@ void bench(std::vector<T> &v, Set &s, bool ins)
 		printf("%20s => %6fms\n", "std::unordered_set", ms);
 }
 
+template<typename T, typename H = Hash>
+void bench_batch(std::vector<T> &v, nm::SwissSet<T, H> &s)
+{
+	using iterator = nm::SwissSet<T, H>::iterator;
+	std::vector<iterator> out(v.size());
+	auto b = nm::Instant::now();
+	volatile int64_t junk = 0;
+
+	s.find_batch(v, out);
+	for (auto &it : out)
+		junk = junk + static_cast<bool>(it);
+	auto ms = b.elapse_ms();
+	printf("%20s => %6fms\n", "swiss batch", ms);
+}
+
 template<typename T, typename H = Hash>
 void bench()
 {
@@ -86,6 +102,7 @@ void bench()
 	printf("----------- %8s search ------------\n", name.c_str());
 	bench(v, s, false);
 	bench(v, sw, false);
+	bench_batch(v, sw);
 	printf("unordered_set cap %lu size %lu load_factor %f\n",
 	       s.bucket_count(),
 	       s.size(),
@@ -96,6 +113,38 @@ void bench()
 	       sw.load_factor());
 }
 
+// per insert latency while the table grows from its default size
+void bench_latency(uint64_t step)
+{
+	int n = 4000000;
+	std::vector<double> lat {};
+	nm::SwissSet<int, Hash> s {};
+
+	lat.reserve(n);
+	s.set_incremental_resize(step);
+	for (int i = 0; i < n; ++i) {
+		auto b = nm::Instant::now();
+		s.insert(i);
+		lat.push_back(b.elapse_usec());
+	}
+	std::sort(lat.begin(), lat.end());
+	printf("%12s step %2lu => p50 %.3fus p99 %.3fus p9999 %.3fus "
+	       "max %.3fus\n",
+	       step ? "incremental" : "rehash",
+	       step,
+	       lat[n / 2],
+	       lat[n / 100 * 99],
+	       lat[n / 10000 * 9999],
+	       lat.back());
+
+	for (int i = 0; i < n; ++i) {
+		if (!s.contains(i)) {
+			printf("missing %d\n", i);
+			break;
+		}
+	}
+}
+
 template<typename K, typename V>
 class Item {
 public:
@@ -230,5 +279,10 @@ int main()
 	bench<int>();
 	bench<std::string>();
 
+	printf("----------- insert latency ------------\n");
+	bench_latency(0);
+	bench_latency(1);
+	bench_latency(4);
+
 	heterogeneous();
 }
\ No newline at end of file
@@ -11,10 +11,13 @@
 #include <cmath>
 #include <concepts>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <emmintrin.h>
 #include <memory>
+#include <span>
 #include <type_traits>
+#include <utility>
 
 namespace nm
 {
@@ -119,6 +122,18 @@ struct SwissEq {
 	}
 };
 
+// types whose bytes stay meaningful when written to a file and read back, so
+// Swiss::save takes them, arithmetic types and enums are, other trivially
+// copyable types must opt in, since being trivially copyable says nothing of
+// pointers inside (std::string_view, std::span, ...)
+//
+//	template<>
+//	struct nm::swiss_plain<Point> : std::true_type {};
+template<typename T>
+struct swiss_plain
+	: std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T>> {
+};
+
 namespace detail
 {
 	template<typename Policy, typename Hash, typename Eq>
@@ -127,6 +142,141 @@ namespace detail
 		{ Eq::eq(k, k) } -> std::convertible_to<bool>;
 	};
 
+	template<typename T>
+	struct plain_data
+		: std::bool_constant<std::is_trivially_copyable_v<T> &&
+				     swiss_plain<std::remove_cv_t<T>>::value> {
+	};
+
+	template<typename K, typename V>
+	struct plain_data<std::pair<K, V>>
+		: std::bool_constant<plain_data<K>::value &&
+				     plain_data<V>::value> {
+	};
+
+	// file layout of Swiss::save, the table block follows the header,
+	// which is padded so that slots keep their alignment when mapped
+	struct alignas(64) snapshot_header {
+		// "SWISSNAP" in little endian
+		static constexpr uint64_t k_magic = 0x50414e5353495753;
+
+		uint64_t magic;
+		uint64_t cap;
+		uint64_t elems;
+		uint64_t slot_size;
+		uint64_t mapped_size;
+		uint64_t bytes;
+	};
+
+	// placeholder mapped_type for layouts without a value array
+	struct none {
+	};
+
+	template<>
+	struct plain_data<none> : std::true_type {
+	};
+
+	template<typename R>
+	struct arrow {
+		R *operator->()
+		{
+			return &ref;
+		}
+
+		R ref;
+	};
+
+	// how a value is stored in the slot array, a Policy derives from
+	// one of these and adds key_type, value_type, key(value_type) and
+	// slot_key(slot_type), see swiss_map.h
+	//
+	// slot holds the value itself, the default
+	template<typename V>
+	struct flat_slot {
+		using slot_type = V;
+		using mapped_type = none;
+		using reference = V &;
+		using pointer = V *;
+
+		static const V &get(const slot_type &s)
+		{
+			return s;
+		}
+
+		static reference element(slot_type *s, mapped_type *)
+		{
+			return *s;
+		}
+
+		static pointer address(slot_type *s, mapped_type *)
+		{
+			return s;
+		}
+
+		static void construct(slot_type *s, mapped_type *, V &&v)
+		{
+			std::construct_at(s, std::move(v));
+		}
+
+		static void destroy(slot_type *s, mapped_type *)
+		{
+			std::destroy_at(s);
+		}
+
+		static void transfer(slot_type *dst,
+				     mapped_type *,
+				     slot_type *src,
+				     mapped_type *)
+		{
+			std::construct_at(dst, std::move(*src));
+			std::destroy_at(src);
+		}
+	};
+
+	// slot holds a pointer to a heap allocated value, references stay
+	// valid across rehash and the slot array is 8 bytes per entry no
+	// matter how large the value is
+	template<typename V>
+	struct node_slot {
+		using slot_type = V *;
+		using mapped_type = none;
+		using reference = V &;
+		using pointer = V *;
+
+		static const V &get(const slot_type &s)
+		{
+			return *s;
+		}
+
+		static reference element(slot_type *s, mapped_type *)
+		{
+			return **s;
+		}
+
+		static pointer address(slot_type *s, mapped_type *)
+		{
+			return *s;
+		}
+
+		static void construct(slot_type *s, mapped_type *, V &&v)
+		{
+			std::construct_at(s, new V { std::move(v) });
+		}
+
+		static void destroy(slot_type *s, mapped_type *)
+		{
+			delete *s;
+		}
+
+		static void transfer(slot_type *dst,
+				     mapped_type *,
+				     slot_type *src,
+				     mapped_type *)
+		{
+			*dst = *src;
+		}
+	};
+
 	// NOTE: prefer moving to copying
 	template<typename Policy,
 		 typename Hash = SwissHash,
@@ -144,12 +294,20 @@ namespace detail
 	public:
 		using key_type = Policy::key_type;
 		using value_type = Policy::value_type;
+		using slot_type = Policy::slot_type;
+		using mapped_type = Policy::mapped_type;
+		using reference = Policy::reference;
+		using pointer = Policy::pointer;
 		struct iterator {
 			friend Swiss;
 
-			value_type &operator*()
+			iterator() : iterator { nullptr, nullptr, nullptr }
+			{
+			}
+
+			reference operator*()
 			{
-				return *slot;
+				return Policy::element(slot, val);
 			}
 
 			explicit operator bool()
@@ -157,16 +315,15 @@ namespace detail
 				return ctrl != nullptr;
 			}
 
-			value_type *operator->()
+			pointer operator->()
 			{
-				return slot;
+				return Policy::address(slot, val);
 			}
 
 			iterator &operator++()
 			{
-				ctrl += 1;
 				assert(slot);
-				slot += 1;
+				advance(1);
 				next();
 				return *this;
 			}
@@ -184,28 +341,57 @@ namespace detail
 			}
 
 		private:
-			iterator(ctrl_t *c, value_type *s)
-				: ctrl { c }, slot { s }
+			iterator(ctrl_t *c,
+				 slot_type *s,
+				 mapped_type *v,
+				 ctrl_t *nc = nullptr,
+				 slot_type *ns = nullptr,
+				 mapped_type *nv = nullptr)
+				: ctrl { c }, slot { s }, val { v }
+				, next_ctrl { nc }, next_slot { ns }
+				, next_val { nv }
 			{
 			}
 
-			void next()
+			void advance(uint64_t n)
+			{
+				ctrl += n;
+				slot += n;
+				val = shift(val, n);
+			}
+
+			void skip()
 			{
 				while (is_empty_or_delete(*ctrl)) {
-					auto shift =
-						group { ctrl }
-							.ctl_empty_or_delete();
-					ctrl += shift;
-					slot += shift;
+					group g { ctrl };
+					advance(g.ctl_empty_or_delete());
 				}
-				if (*ctrl == k_sentinel) {
-					slot = nullptr;
-					ctrl = nullptr;
+			}
+
+			void next()
+			{
+				while (true) {
+					skip();
+					if (*ctrl != k_sentinel)
+						return;
+					if (!next_ctrl) {
+						*this = {};
+						return;
+					}
+					// the table being migrated is done,
+					// continue with the new one
+					*this = { next_ctrl,
+						  next_slot,
+						  next_val };
 				}
 			}
 
 			ctrl_t *ctrl;
-			value_type *slot;
+			slot_type *slot;
+			mapped_type *val;
+			ctrl_t *next_ctrl;
+			slot_type *next_slot;
+			mapped_type *next_val;
 		};
 
 		explicit Swiss(uint64_t size = k_width * 2)
@@ -214,7 +400,7 @@ namespace detail
 			, cap_ { calc_cap(groups_) }
 		{
 			assert(is_power_of_2(groups_));
-			new_table(cap_, &ctrl_, &slot_);
+			new_table(cap_, &ctrl_, &slot_, &val_);
 		}
 
 		Swiss(const Swiss &) = delete;
@@ -225,6 +411,7 @@ namespace detail
 			, cap_ { 0 }
 			, ctrl_ { 0 }
 			, slot_ { 0 }
+			, val_ { 0 }
 		{
 			*this = std::move(s);
 		}
@@ -247,6 +434,15 @@ namespace detail
 				std::swap(cap_, s.cap_);
 				std::swap(ctrl_, s.ctrl_);
 				std::swap(slot_, s.slot_);
+				std::swap(val_, s.val_);
+				std::swap(load_factor_, s.load_factor_);
+				std::swap(step_, s.step_);
+				std::swap(old_cap_, s.old_cap_);
+				std::swap(old_elems_, s.old_elems_);
+				std::swap(moved_, s.moved_);
+				std::swap(old_ctrl_, s.old_ctrl_);
+				std::swap(old_slot_, s.old_slot_);
+				std::swap(old_val_, s.old_val_);
 			}
 			return *this;
 		}
@@ -271,37 +467,83 @@ namespace detail
 			return load_factor_;
 		}
 
+		// when groups is non-zero, growing the table no longer
+		// rehashes everything at once: the old table is kept and at
+		// most `groups` groups of it are moved into the new one on
+		// every insert/erase, lookups check both tables meanwhile
+		void set_incremental_resize(uint64_t groups)
+		{
+			step_ = groups;
+			if (step_ == 0)
+				finish_migration();
+		}
+
+		bool resizing() const
+		{
+			return old_ctrl_ != nullptr;
+		}
+
 		template<typename T = key_type>
 		iterator find(const T &key) const
 		{
 			uint64_t hash = Hash::hash(key);
-			auto pattern = _mm_set1_epi8(H2(hash));
-			prober seq { H1(hash), cap_ };
-			matcher m { 0 };
 
-			prefetch(seq.offset());
-			while (true) {
-				group g { ctrl_ + seq.offset() };
-				m = g.match(pattern);
+			prefetch(H1(hash) & cap_);
+			return find_with_hash(key, hash);
+		}
 
-				while (m) {
-					auto i = seq.offset(*m);
-					if (Eq::eq(Policy::key(slot_[i]), key))
-						return iterator_at(i);
-					++m;
+		// look up keys[i] into out[i] (end() if absent), hashes of a
+		// whole batch are computed first, then the groups of key i +
+		// k_prefetch are prefetched while key i is being probed, so
+		// that cache misses of different keys overlap
+		template<typename T = key_type>
+		void find_batch(std::span<const T> keys,
+				std::span<iterator> out) const
+		{
+			uint64_t hash[k_batch];
+
+			assert(out.size() >= keys.size());
+			for (size_t base = 0; base < keys.size();
+			     base += k_batch) {
+				auto n = std::min<size_t>(k_batch,
+							  keys.size() - base);
+				for (size_t i = 0; i < n; ++i) {
+					hash[i] = Hash::hash(keys[base + i]);
+					if (i < k_prefetch)
+						prefetch(H1(hash[i]) & cap_);
+				}
+				for (size_t i = 0; i < n; ++i) {
+					auto j = i + k_prefetch;
+					if (j < n)
+						prefetch(H1(hash[j]) & cap_);
+					out[base + i] =
+						find_with_hash(keys[base + i],
+							       hash[i]);
 				}
-				if (g.match_empty())
-					return end();
-				seq.next();
 			}
 		}
 
+		void find_batch(std::span<const key_type> keys,
+				std::span<iterator> out) const
+		{
+			find_batch<key_type>(keys, out);
+		}
+
 		template<typename T>
 		bool contains(const T &key) const
 		{
 			return find(key) != end();
 		}
 
+		// number of groups probed to find key or to tell it's absent
+		template<typename T = key_type>
+		uint64_t probe_length(const T &key) const
+		{
+			uint64_t n = 0;
+			probe(ctrl_, slot_, cap_, key, Hash::hash(key), &n);
+			return n;
+		}
+
 		iterator insert(const value_type &key)
 		{
 			auto v = key;
@@ -318,6 +560,8 @@ namespace detail
 		template<typename T>
 		bool erase(const T &key)
 		{
+			if (old_ctrl_)
+				migrate(step_);
 			auto iter = find(key);
 
 			if (iter == end())
@@ -338,10 +582,22 @@ namespace detail
 		void reserve(size_t size)
 		{
 			assert(cap_ != 0);
+			finish_migration();
 			if (size > cap_) {
 				Swiss tmp { size };
-				for (auto &i : *this)
-					tmp.emplace(std::move(i));
+				// the move swaps these as well, keep them
+				tmp.load_factor_ = load_factor_;
+				tmp.step_ = step_;
+				for (uint64_t i = 0; i < cap_; ++i) {
+					if (!is_empty_or_delete(ctrl_[i]))
+						tmp.place(slot_ + i,
+							  shift(val_, i));
+				}
+				tmp.elems_ = elems_;
+				// slots are transferred, nothing to destroy
+				free(ctrl_);
+				ctrl_ = nullptr;
+				elems_ = 0;
 				*this = std::move(tmp);
 			}
 		}
@@ -367,31 +623,123 @@ namespace detail
 			for (auto iter = begin(); iter != end(); ++iter)
 				invalidate(iter.ctrl);
 			elems_ = 0;
+			free_old();
 		}
 
 		iterator begin() const
 		{
 			auto it = iterator_at(0);
+			if (old_ctrl_)
+				it = { old_ctrl_, old_slot_, old_val_,
+				       ctrl_,	  slot_,     val_ };
 			it.next();
 			return it;
 		}
 
 		iterator end() const
 		{
-			return { nullptr, nullptr };
+			return {};
+		}
+
+		// dump header and table block to path, the block can be mapped
+		// back by FrozenSwissMap on a machine of the same endianness,
+		// the same Hash must be used there
+		bool save(const char *path)
+			requires plain_data<slot_type>::value &&
+			plain_data<mapped_type>::value
+		{
+			static_assert(slot_align() <= sizeof(snapshot_header));
+			static_assert(alignof(mapped_type) <=
+				      sizeof(snapshot_header));
+
+			finish_migration();
+			snapshot_header h {};
+			h.magic = snapshot_header::k_magic;
+			h.cap = cap_;
+			h.elems = elems_;
+			h.slot_size = sizeof(slot_type);
+			h.mapped_size = sizeof(mapped_type);
+			h.bytes = table_bytes(cap_);
+
+			auto fp = fopen(path, "wb");
+			if (!fp)
+				return false;
+			bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+				  fwrite(ctrl_, h.bytes, 1, fp) == 1;
+			return fclose(fp) == 0 && ok;
+		}
+
+	protected:
+		// adopt a table written by save(), which is len bytes starting
+		// at h, the memory is owned by caller and must outlive the
+		// table or be released by detach()
+		bool attach(const snapshot_header *h, uint64_t len)
+		{
+			if (len < sizeof(*h) ||
+			    h->magic != snapshot_header::k_magic ||
+			    h->slot_size != sizeof(slot_type) ||
+			    h->mapped_size != sizeof(mapped_type) ||
+			    (h->cap + 1) % k_width != 0 ||
+			    !is_power_of_2((h->cap + 1) / k_width) ||
+			    h->bytes != table_bytes(h->cap) ||
+			    len - sizeof(*h) < h->bytes || h->elems > h->cap)
+				return false;
+			// probing stops at the sentinel, a table without it
+			// would be walked past its end
+			auto ctrl = reinterpret_cast<const ctrl_t *>(h + 1);
+			if (ctrl[h->cap] != k_sentinel)
+				return false;
+
+			if (ctrl_)
+				clear();
+			free(ctrl_);
+			ctrl_ = const_cast<ctrl_t *>(ctrl);
+			slot_ = reinterpret_cast<slot_type *>(
+				ctrl_ + slot_offset(h->cap));
+			val_ = nullptr;
+			if constexpr (k_split)
+				val_ = reinterpret_cast<mapped_type *>(
+					ctrl_ + val_offset(h->cap));
+			cap_ = h->cap;
+			groups_ = (cap_ + 1) / k_width;
+			elems_ = h->elems;
+			return true;
+		}
+
+		void detach()
+		{
+			ctrl_ = nullptr;
+			slot_ = nullptr;
+			val_ = nullptr;
+			elems_ = 0;
 		}
 
 	private:
 		enum {
 			k_width = 16,
 			k_clone = k_width - 1, // adapt float window
+			k_batch = 32, // keys hashed ahead in find_batch
+			k_prefetch = 8, // prefetch distance in find_batch
 		};
+		static constexpr bool k_split =
+			!std::is_same_v<mapped_type, detail::none>;
 		uint64_t elems_ = 0;
 		double load_factor_ = 15.0 / static_cast<int>(k_width);
 		uint64_t groups_;
 		uint64_t cap_;
 		ctrl_t *ctrl_;
-		value_type *slot_;
+		slot_type *slot_;
+		// parallel value array, only used by split layout
+		mapped_type *val_;
+		// the table being migrated in incremental resize mode, slots
+		// before moved_ have been moved to ctrl_/slot_
+		uint64_t step_ = 0;
+		uint64_t old_cap_ = 0;
+		uint64_t old_elems_ = 0;
+		uint64_t moved_ = 0;
+		ctrl_t *old_ctrl_ = nullptr;
+		slot_type *old_slot_ = nullptr;
+		mapped_type *old_val_ = nullptr;
 
 		static constexpr bool is_empty_or_delete(ctrl_t ctrl)
 		{
@@ -544,7 +892,7 @@ namespace detail
 
 		static constexpr uint64_t slot_align()
 		{
-			return std::max(alignof(value_type), sizeof(uint64_t));
+			return std::max(alignof(slot_type), sizeof(uint64_t));
 		}
 
 		static constexpr uint64_t slot_offset(uint64_t cap)
@@ -555,7 +903,30 @@ namespace detail
 
 		static constexpr uint64_t slot_bytes(uint64_t cap)
 		{
-			return slot_offset(cap) + cap * sizeof(value_type);
+			return slot_offset(cap) + cap * sizeof(slot_type);
+		}
+
+		static constexpr uint64_t val_offset(uint64_t cap)
+		{
+			auto align = alignof(mapped_type);
+			return (slot_bytes(cap) + align - 1) & (~align + 1);
+		}
+
+		static constexpr uint64_t table_bytes(uint64_t cap)
+		{
+			if constexpr (k_split)
+				return val_offset(cap) +
+				       cap * sizeof(mapped_type);
+			else
+				return slot_bytes(cap);
+		}
+
+		static mapped_type *shift(mapped_type *val, uint64_t n)
+		{
+			if constexpr (k_split)
+				return val + n;
+			else
+				return val;
 		}
 
 		static constexpr void
@@ -567,30 +938,50 @@ namespace detail
 			ctrl[((i - k_clone) & mask) + (k_clone & mask)] = h2;
 		}
 
-		static void
-		new_table(uint64_t cap, ctrl_t **ctrl, value_type **slot)
+		static void new_table(uint64_t cap,
+				      ctrl_t **ctrl,
+				      slot_type **slot,
+				      mapped_type **val)
 		{
 			static_assert(sizeof(ctrl_t) == 1);
-			auto size = slot_bytes(cap) + ctrl_bytes(cap);
+			auto size = table_bytes(cap) + ctrl_bytes(cap);
 			*ctrl = reinterpret_cast<ctrl_t *>(malloc(size));
-			*slot = reinterpret_cast<value_type *>(
+			*slot = reinterpret_cast<slot_type *>(
 				*ctrl + slot_offset(cap));
+			*val = nullptr;
+			if constexpr (k_split)
+				*val = reinterpret_cast<mapped_type *>(
+					*ctrl + val_offset(cap));
 			std::memset(*ctrl, k_empty, ctrl_bytes(cap));
 			(*ctrl)[cap] = k_sentinel;
 		}
 
 		auto iterator_at(uint64_t pos) const
 		{
-			return iterator { ctrl_ + pos, slot_ + pos };
+			return iterator { ctrl_ + pos,
+					  slot_ + pos,
+					  shift(val_, pos) };
 		}
 
 		void invalidate(const ctrl_t *item)
 		{
 			// NOTE: can't set to k_empty, since insert and
 			// find rely on k_empty to stop search
+			if (old_ctrl_ && item >= old_ctrl_ &&
+			    item < old_ctrl_ + old_cap_) {
+				uint64_t offset = item - old_ctrl_;
+				set_ctrl(old_ctrl_,
+					 offset,
+					 k_deleted,
+					 old_cap_);
+				Policy::destroy(old_slot_ + offset,
+						shift(old_val_, offset));
+				old_elems_ -= 1;
+				return;
+			}
 			uint64_t offset = item - ctrl_;
 			set_ctrl(ctrl_, offset, k_deleted, cap_);
-			std::destroy_at(slot_ + offset);
+			Policy::destroy(slot_ + offset, shift(val_, offset));
 		}
 
 		void prefetch(uint64_t offset) const
@@ -600,12 +991,163 @@ namespace detail
 			__builtin_prefetch(slot_ + offset, 0, 3);
 		}
 
+		template<typename T>
+		static const ctrl_t *probe(const ctrl_t *ctrl,
+					   const slot_type *slot,
+					   uint64_t cap,
+					   const T &key,
+					   uint64_t hash,
+					   uint64_t *groups = nullptr)
+		{
+			auto pattern = _mm_set1_epi8(H2(hash));
+			prober seq { H1(hash), cap };
+			matcher m { 0 };
+			uint64_t n = 0;
+
+			// a table being migrated may have no k_empty left, the
+			// probe sequence visits every group once in that many
+			// steps, so stop there
+			for (; n <= cap / k_width; ++n) {
+				group g { ctrl + seq.offset() };
+				m = g.match(pattern);
+
+				while (m) {
+					auto i = seq.offset(*m);
+					if (Eq::eq(Policy::slot_key(slot[i]),
+						   key)) {
+						if (groups)
+							*groups = n + 1;
+						return ctrl + i;
+					}
+					++m;
+				}
+				if (g.match_empty())
+					break;
+				seq.next();
+			}
+			if (groups)
+				*groups = std::min(n + 1, cap / k_width + 1);
+			return nullptr;
+		}
+
+		template<typename T>
+		iterator find_with_hash(const T &key, uint64_t hash) const
+		{
+			auto c = probe(ctrl_, slot_, cap_, key, hash);
+
+			if (c)
+				return iterator_at(c - ctrl_);
+			if (old_ctrl_) {
+				c = probe(old_ctrl_,
+					  old_slot_,
+					  old_cap_,
+					  key,
+					  hash);
+				if (c) {
+					auto i = c - old_ctrl_;
+					return { old_ctrl_ + i,
+						 old_slot_ + i,
+						 shift(old_val_, i),
+						 ctrl_,
+						 slot_,
+						 val_ };
+				}
+			}
+			return end();
+		}
+
+		void start_migration()
+		{
+			assert(!old_ctrl_);
+			old_ctrl_ = ctrl_;
+			old_slot_ = slot_;
+			old_val_ = val_;
+			old_cap_ = cap_;
+			old_elems_ = elems_;
+			moved_ = 0;
+			groups_ *= 2;
+			cap_ = calc_cap(groups_);
+			new_table(cap_, &ctrl_, &slot_, &val_);
+		}
+
+		// move at most `groups` groups from the old table into the new
+		// one, the moved slots are marked deleted so that probing in
+		// old table still walks through them
+		void migrate(uint64_t groups)
+		{
+			auto last =
+				std::min(moved_ + groups * k_width, old_cap_);
+
+			for (; moved_ < last && old_elems_ != 0; ++moved_) {
+				if (is_empty_or_delete(old_ctrl_[moved_]))
+					continue;
+				place(old_slot_ + moved_,
+				      shift(old_val_, moved_));
+				set_ctrl(old_ctrl_,
+					 moved_,
+					 k_deleted,
+					 old_cap_);
+				old_elems_ -= 1;
+			}
+			if (moved_ == old_cap_ || old_elems_ == 0)
+				free_old();
+		}
+
+		void finish_migration()
+		{
+			if (old_ctrl_)
+				migrate(old_cap_);
+		}
+
+		void free_old()
+		{
+			free(old_ctrl_);
+			old_ctrl_ = nullptr;
+			old_slot_ = nullptr;
+			old_val_ = nullptr;
+			old_cap_ = 0;
+			old_elems_ = 0;
+			moved_ = 0;
+		}
+
+		// move a slot known to be absent from this table into it, the
+		// source slot is left destroyed
+		void place(slot_type *s, mapped_type *v)
+		{
+			auto hash = Hash::hash(Policy::slot_key(*s));
+			prober seq { H1(hash), cap_ };
+
+			while (true) {
+				group g { ctrl_ + seq.offset() };
+				auto m = g.match_empty_or_delete();
+				if (m) {
+					auto pos = seq.offset(*m);
+					set_ctrl(ctrl_, pos, H2(hash), cap_);
+					Policy::transfer(slot_ + pos,
+							 shift(val_, pos),
+							 s,
+							 v);
+					return;
+				}
+				seq.next();
+			}
+		}
+
 		iterator try_insert(value_type &&v)
 		{
-			if (load_factor() > max_load_factor())
-				reserve(calc_cap(groups_ * 2));
+			if (old_ctrl_)
+				migrate(step_);
+			if (load_factor() > max_load_factor()) {
+				if (step_ == 0 || old_ctrl_)
+					reserve(calc_cap(groups_ * 2));
+				else
+					start_migration();
+			}
 			const auto &key = Policy::key(v);
 			auto hash = Hash::hash(key);
+			if (old_ctrl_ &&
+			    probe(old_ctrl_, old_slot_, old_cap_, key, hash))
+				return end();
 			auto h2 = H2(hash);
 			auto pattern = _mm_set1_epi8(h2);
 			prober seq { H1(hash), cap_ };
@@ -615,8 +1157,8 @@ namespace detail
 				auto m = g.match(pattern);
 
 				while (m) {
-					if (Eq::eq(Policy::key(slot_[seq.offset(
-							   *m)]),
+					auto i = seq.offset(*m);
+					if (Eq::eq(Policy::slot_key(slot_[i]),
 						   key))
 						return end();
 					++m;
@@ -625,7 +1167,8 @@ namespace detail
 				if (m) {
 					auto pos = seq.offset(*m);
 					set_ctrl(ctrl_, pos, h2, cap_);
-					std::construct_at(slot_ + pos,
+					Policy::construct(slot_ + pos,
+							  shift(val_, pos),
 							  std::move(v));
 					elems_ += 1;
 					return iterator_at(pos);
@@ -0,0 +1,285 @@
+/*********************************************************
+	  File Name: parallel.h
+	  Author: Abby Cin
+	  Mail: abbytsing@gmail.com
+	  Created Time: Mon 19 Oct 2026 03:20:41 PM CST
+**********************************************************/
+
+#ifndef THREAD_POOL_PARALLEL_H_
+#define THREAD_POOL_PARALLEL_H_
+
+#include "threadpool.h"
+#include <algorithm>
+#include <bit>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <semaphore>
+#include <utility>
+
+// fork-join algorithms on a threadpool, a range is cut in halves until a
+// piece holds at most grain elements, each cut runs one half in place and
+// hands the other to the pool, the thread waiting for that half runs queued
+// tasks meanwhile instead of blocking
+//
+//	nm::parallel_for(pool, v, 1024, [](auto &x) { x *= 2; });
+//	auto sum = nm::parallel_reduce(pool, v, 1024, 0L, std::plus<> {});
+//	nm::parallel_transform(pool, v, out.begin(), 1024, f);
+//	nm::parallel_sort(pool, v);
+//
+// fn and op are called from several threads at once, an exception from any
+// piece reaches the caller once every piece is done, pieces dropped by
+// threadpool::stop() are reported as broken_promise
+namespace nm
+{
+namespace detail
+{
+	// releases done once a forked half is gone, run or dropped
+	class Forked {
+	public:
+		Forked(std::binary_semaphore &done, std::exception_ptr &err)
+			: done_ { &done }, err_ { &err }
+		{
+		}
+
+		Forked(Forked &&rhs) noexcept
+			: done_ { std::exchange(rhs.done_, nullptr) }
+			, err_ { rhs.err_ }
+			, ran_ { rhs.ran_ }
+		{
+		}
+
+		Forked &operator=(Forked &&) = delete;
+
+		~Forked()
+		{
+			if (!done_)
+				return;
+			if (!ran_) {
+				auto e = std::future_errc::broken_promise;
+				*err_ = std::make_exception_ptr(
+					std::future_error(e));
+			}
+			done_->release();
+		}
+
+		template<typename F>
+		void run(F &f)
+		{
+			try {
+				f();
+			}
+			catch (...) {
+				*err_ = std::current_exception();
+			}
+			ran_ = true;
+		}
+
+	private:
+		std::binary_semaphore *done_;
+		std::exception_ptr *err_;
+		bool ran_ = false;
+	};
+
+	// run queued tasks until done is released, after a run of misses wait
+	// in short slices and look again in between, the half being waited
+	// for may fork more work, which this thread should help with rather
+	// than sleep through
+	inline void help(threadpool &pool, std::binary_semaphore &done)
+	{
+		constexpr auto slice = std::chrono::microseconds(50);
+		for (unsigned miss = 0; !done.try_acquire();) {
+			if (pool.run_one())
+				miss = 0;
+			else if (++miss < 64)
+				std::this_thread::yield();
+			else if (done.try_acquire_for(slice))
+				return;
+		}
+	}
+
+	// right goes to the pool, or runs here when the queue is full
+	template<typename L, typename R>
+	void fork_join(threadpool &pool, L &&left, R &&right)
+	{
+		std::binary_semaphore done(0);
+		std::exception_ptr err, lerr;
+		pool.post_or_run([&right, f = Forked(done, err)]() mutable
+				 { f.run(right); });
+		try {
+			left();
+		}
+		catch (...) {
+			lerr = std::current_exception();
+		}
+		help(pool, done);
+		if (lerr)
+			std::rethrow_exception(lerr);
+		if (err)
+			std::rethrow_exception(err);
+	}
+
+	// leaf(first, last) on pieces of at most grain elements
+	template<typename F>
+	void split(threadpool &pool,
+		   size_t first,
+		   size_t last,
+		   size_t grain,
+		   const F &leaf)
+	{
+		if (last - first <= grain) {
+			leaf(first, last);
+			return;
+		}
+		auto mid = first + (last - first) / 2;
+		fork_join(
+			pool,
+			[&] { split(pool, first, mid, grain, leaf); },
+			[&] { split(pool, mid, last, grain, leaf); });
+	}
+
+	template<typename T, typename I, typename Op>
+	T reduce(threadpool &pool,
+		 I it,
+		 size_t first,
+		 size_t last,
+		 size_t grain,
+		 const Op &op)
+	{
+		using D = std::iter_difference_t<I>;
+		if (last - first <= grain) {
+			T acc = it[static_cast<D>(first)];
+			for (auto i = first + 1; i < last; ++i)
+				acc = op(std::move(acc), it[static_cast<D>(i)]);
+			return acc;
+		}
+		auto mid = first + (last - first) / 2;
+		std::optional<T> l, r;
+		auto half = [&](std::optional<T> &x, size_t from, size_t to)
+		{ x.emplace(reduce<T>(pool, it, from, to, grain, op)); };
+		fork_join(
+			pool,
+			[&] { half(l, first, mid); },
+			[&] { half(r, mid, last); });
+		return op(std::move(*l), std::move(*r));
+	}
+
+	// three-way quicksort, pieces of at most grain elements or past the
+	// depth limit are left to std::sort
+	template<typename I, typename C>
+	void quicksort(threadpool &pool,
+		       I first,
+		       size_t n,
+		       size_t grain,
+		       const C &comp,
+		       int depth)
+	{
+		using D = std::iter_difference_t<I>;
+		auto last = first + static_cast<D>(n);
+		if (n <= grain || depth == 0) {
+			std::sort(first, last, comp);
+			return;
+		}
+		// median of three goes to the front and stays there while the
+		// rest is partitioned around it
+		auto a = first;
+		auto b = first + static_cast<D>(n / 2);
+		auto c = last - 1;
+		if (comp(*b, *a))
+			std::iter_swap(a, b);
+		if (comp(*c, *b)) {
+			std::iter_swap(b, c);
+			if (comp(*b, *a))
+				std::iter_swap(a, b);
+		}
+		std::iter_swap(first, b);
+		auto lt = std::partition(first + 1,
+					 last,
+					 [&](const auto &x)
+					 { return comp(x, *first); });
+		auto gt = std::partition(lt,
+					 last,
+					 [&](const auto &x)
+					 { return !comp(*first, x); });
+		std::iter_swap(first, lt - 1);
+		// [first, lt - 1) is less than the pivot, [gt, last) greater,
+		// what is between is equal and in place
+		auto nl = static_cast<size_t>(lt - 1 - first);
+		auto nr = static_cast<size_t>(last - gt);
+		auto half = [&](I from, size_t k)
+		{ quicksort(pool, from, k, grain, comp, depth - 1); };
+		fork_join(
+			pool, [&] { half(first, nl); }, [&] { half(gt, nr); });
+	}
+} // namespace detail
+
+template<std::ranges::random_access_range R, typename F>
+void parallel_for(threadpool &pool, R &&r, size_t grain, F fn)
+{
+	using D = std::ranges::range_difference_t<R>;
+	auto it = std::ranges::begin(r);
+	auto n = static_cast<size_t>(std::ranges::distance(r));
+	detail::split(pool,
+		      0,
+		      n,
+		      std::max<size_t>(grain, 1),
+		      [&](size_t first, size_t last)
+		      {
+			      for (auto i = first; i < last; ++i)
+				      fn(it[static_cast<D>(i)]);
+		      });
+}
+
+// op must be associative, init is folded in once, at the end
+template<std::ranges::random_access_range R, typename T, typename Op>
+T parallel_reduce(threadpool &pool, R &&r, size_t grain, T init, Op op)
+{
+	auto it = std::ranges::begin(r);
+	auto n = static_cast<size_t>(std::ranges::distance(r));
+	if (n == 0)
+		return init;
+	auto acc = detail::reduce<T>(
+		pool, it, 0, n, std::max<size_t>(grain, 1), op);
+	return op(std::move(init), std::move(acc));
+}
+
+// out[i] = fn(r[i]), returns the end of what was written
+template<std::ranges::random_access_range R,
+	 std::random_access_iterator O,
+	 typename F>
+O parallel_transform(threadpool &pool, R &&r, O out, size_t grain, F fn)
+{
+	using D = std::ranges::range_difference_t<R>;
+	using E = std::iter_difference_t<O>;
+	auto it = std::ranges::begin(r);
+	auto n = static_cast<size_t>(std::ranges::distance(r));
+	detail::split(pool,
+		      0,
+		      n,
+		      std::max<size_t>(grain, 1),
+		      [&](size_t first, size_t last)
+		      {
+			      for (auto i = first; i < last; ++i)
+				      out[static_cast<E>(i)] =
+					      fn(it[static_cast<D>(i)]);
+		      });
+	return out + static_cast<E>(n);
+}
+
+// not stable
+template<std::ranges::random_access_range R,
+	 typename C = std::ranges::less>
+void parallel_sort(threadpool &pool, R &&r, C comp = {})
+{
+	auto first = std::ranges::begin(r);
+	auto n = static_cast<size_t>(std::ranges::distance(r));
+	// enough pieces to go round, not so many that forking dominates
+	auto grain = std::max<size_t>(n / 256, 2048);
+	auto depth = 2 * static_cast<int>(std::bit_width(n));
+	detail::quicksort(pool, first, n, grain, comp, depth);
+}
+} // namespace nm
+
+#endif // THREAD_POOL_PARALLEL_H_
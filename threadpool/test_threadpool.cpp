@@ -5,13 +5,342 @@
 	  Created Time: Thu 04 Aug 2016 10:43:26 AM CST
 **********************************************************/
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <latch>
+#include <new>
+#include <numeric>
+#include <queue>
 #include "threadpool.h"
+#include "parallel.h"
 
 using namespace std;
 
+// every allocation in the process is counted, to see what a task costs, kept
+// out of line or gcc sees malloc and free paired with new and delete
+static atomic<size_t> allocs { 0 };
+
+__attribute__((noinline)) void *operator new(size_t n)
+{
+	allocs.fetch_add(1, memory_order_relaxed);
+	if (auto p = malloc(n ? n : 1))
+		return p;
+	throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+// one lock, one queue and one condvar shared by every worker, what
+// nm::threadpool used to be, for comparison
+class LockedPool {
+public:
+	explicit LockedPool(size_t threads)
+	{
+		for (; threads > 0; --threads)
+			workers_.emplace_back([this] { run(); });
+	}
+	~LockedPool()
+	{
+		{
+			unique_lock<mutex> l(lock_);
+			exit_ = true;
+			cond_.notify_all();
+		}
+		for (auto &t : workers_)
+			t.join();
+	}
+	template<typename F, typename... Args>
+	auto add_task(F &&f, Args &&...args)
+		-> future<typename invoke_result<F, Args...>::type>
+	{
+		using R = typename invoke_result<F, Args...>::type;
+		auto task = make_shared<packaged_task<R()>>(
+			bind(std::forward<F>(f), std::forward<Args>(args)...));
+		auto res(task->get_future());
+		{
+			unique_lock<mutex> l(lock_);
+			tasks_.emplace([task] { (*task)(); });
+		}
+		cond_.notify_one();
+		return res;
+	}
+	void set_queue_size_limit(size_t)
+	{
+	}
+
+private:
+	void run()
+	{
+		for (;;) {
+			unique_lock<mutex> l(lock_);
+			cond_.wait(l,
+				   [this] { return exit_ || !tasks_.empty(); });
+			if (tasks_.empty())
+				return;
+			auto task(std::move(tasks_.front()));
+			tasks_.pop();
+			l.unlock();
+			task();
+		}
+	}
+
+	bool exit_ = false;
+	vector<thread> workers_;
+	queue<function<void()>> tasks_;
+	mutex lock_;
+	condition_variable cond_;
+};
+
+// a little work per task so the queue isn't all that's measured
+static size_t spin(size_t x)
+{
+	for (int i = 0; i < 100; ++i)
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+	return x;
+}
+
+// every task is added from the main thread
+template<typename Pool>
+double flat(Pool &pool, size_t n)
+{
+	auto start = chrono::steady_clock::now();
+	vector<future<size_t>> res;
+	res.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		res.push_back(pool.add_task(spin, i));
+	size_t sum = 0;
+	for (auto &f : res)
+		sum += f.get();
+	chrono::duration<double> d = chrono::steady_clock::now() - start;
+	return sum ? n / d.count() : 0;
+}
+
+// every task adds two more until depth runs out, tasks are added by the
+// workers themselves
+template<typename Pool>
+struct Tree {
+	Pool &pool;
+	atomic<size_t> left;
+	promise<void> done;
+
+	void node(int depth)
+	{
+		if (depth == 0) {
+			spin(depth);
+			if (left.fetch_sub(1) == 1)
+				done.set_value();
+			return;
+		}
+		pool.add_task(&Tree::node, this, depth - 1);
+		pool.add_task(&Tree::node, this, depth - 1);
+	}
+};
+
+template<typename Pool>
+double tree(Pool &pool, int depth)
+{
+	Tree<Pool> t { pool, size_t(1) << depth, {} };
+	auto start = chrono::steady_clock::now();
+	auto fut = t.done.get_future();
+	pool.add_task(&Tree<Pool>::node, &t, depth);
+	fut.get();
+	chrono::duration<double> d = chrono::steady_clock::now() - start;
+	return ((size_t(2) << depth) - 1) / d.count();
+}
+
+template<typename Pool>
+void scaling(const char *name)
+{
+	for (size_t n : { 1, 2, 4, 8 }) {
+		auto pool = Pool::make(n);
+		pool->set_queue_size_limit(SIZE_MAX);
+		auto f = flat(*pool, 200000);
+		auto t = tree(*pool, 17);
+		printf("%s %lu threads: flat %.2f M tasks/s, tree %.2f M "
+		       "tasks/s\n",
+		       name,
+		       n,
+		       f / 1e6,
+		       t / 1e6);
+	}
+}
+
+// tasks that only count down, what's measured is getting a task to a worker
+template<typename Submit>
+void overhead(const char *name, size_t n, Submit submit)
+{
+	latch done(static_cast<ptrdiff_t>(n));
+	auto a = allocs.load();
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i)
+		submit([&done] { done.count_down(); });
+	done.wait();
+	chrono::duration<double> d = chrono::steady_clock::now() - start;
+	printf("%s: %.2f M tasks/s, %.2f allocations per task\n",
+	       name,
+	       n / d.count() / 1e6,
+	       double(allocs.load() - a) / n);
+}
+
+// busy for d, a batch task that keeps its worker
+static void burn(chrono::microseconds d)
+{
+	auto end = chrono::steady_clock::now() + d;
+	while (chrono::steady_clock::now() < end)
+		;
+}
+
+// a backlog of batch work in front of interactive tasks that arrive one by
+// one, how long an interactive task waits before it starts
+static void lanes(nm::lane backlog)
+{
+	nm::threadpool pool(launch::async, 4);
+	pool.set_queue_size_limit(SIZE_MAX);
+	for (int i = 0; i < 4000; ++i)
+		pool.post(backlog, burn, chrono::microseconds(200));
+	size_t n = 200;
+	vector<double> wait(n);
+	latch done(static_cast<ptrdiff_t>(n));
+	for (size_t i = 0; i < n; ++i) {
+		auto t = chrono::steady_clock::now();
+		pool.post(nm::lane::interactive,
+			  [&, i, t]
+			  {
+				  chrono::duration<double, micro> d =
+					  chrono::steady_clock::now() - t;
+				  wait[i] = d.count();
+				  done.count_down();
+			  });
+		this_thread::sleep_for(chrono::microseconds(500));
+	}
+	done.wait();
+	pool.stop();
+	sort(wait.begin(), wait.end());
+	printf("backlog in the %s lane: interactive waits p50 %.0f us, p99 "
+	       "%.0f us\n",
+	       backlog == nm::lane::batch ? "batch" : "interactive",
+	       wait[n / 2],
+	       wait[n * 99 / 100]);
+}
+
+// stop() while another thread keeps posting, every queued task must be run
+// or dropped by then, a future still pending long after was left behind
+static void stop_under_load(size_t rounds)
+{
+	size_t left = 0;
+	for (size_t r = 0; r < rounds; ++r) {
+		nm::threadpool pool(launch::async, 4);
+		pool.set_queue_size_limit(SIZE_MAX);
+		vector<future<size_t>> res;
+		res.reserve(2000);
+		for (size_t i = 0; i < 2000; ++i)
+			res.push_back(pool.add_task(spin, i));
+		atomic<bool> go { true };
+		thread poster(
+			[&]
+			{
+				try {
+					while (go)
+						pool.post([] {});
+				}
+				catch (runtime_error &) {
+				}
+			});
+		this_thread::sleep_for(chrono::microseconds(r % 200));
+		pool.stop();
+		go = false;
+		poster.join();
+		for (auto &f : res) {
+			auto s = f.wait_for(chrono::milliseconds(500));
+			left += s != future_status::ready;
+		}
+	}
+	printf("stop under load: %zu rounds, %zu tasks left behind\n",
+	       rounds,
+	       left);
+}
+
+// the fork-join layer against the plain loops it stands in for
+static void algorithms()
+{
+	nm::threadpool pool;
+	auto time = [](auto f)
+	{
+		auto start = chrono::steady_clock::now();
+		f();
+		chrono::duration<double, milli> d =
+			chrono::steady_clock::now() - start;
+		return d.count();
+	};
+	size_t n = 1 << 22;
+	vector<uint32_t> v(n);
+	uint32_t x = 1;
+	for (auto &e : v) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		e = x;
+	}
+	auto w = v;
+	auto a = time([&] { sort(w.begin(), w.end()); });
+	auto b = time([&] { nm::parallel_sort(pool, v); });
+	printf("sort %zu: std::sort %.1f ms, parallel_sort %.1f ms%s\n",
+	       n,
+	       a,
+	       b,
+	       v == w ? "" : ", results differ");
+	uint64_t s1 = 0, s2 = 0;
+	a = time([&] { s1 = accumulate(v.begin(), v.end(), uint64_t(0)); });
+	b = time(
+		[&] {
+			s2 = nm::parallel_reduce(
+				pool, v, 1 << 14, uint64_t(0), plus<> {});
+		});
+	printf("sum %zu: accumulate %.1f ms, parallel_reduce %.1f ms%s\n",
+	       n,
+	       a,
+	       b,
+	       s1 == s2 ? "" : ", results differ");
+	n = 1 << 18;
+	vector<size_t> in(n), o1(n), o2(n);
+	iota(in.begin(), in.end(), 0);
+	a = time([&] { transform(in.begin(), in.end(), o1.begin(), spin); });
+	b = time([&]
+		 { nm::parallel_transform(pool, in, o2.begin(), 256, spin); });
+	printf("transform %zu: std::transform %.1f ms, parallel_transform "
+	       "%.1f ms%s\n",
+	       n,
+	       a,
+	       b,
+	       o1 == o2 ? "" : ", results differ");
+}
+
+struct Locked {
+	static auto make(size_t n)
+	{
+		return make_unique<LockedPool>(n);
+	}
+};
+
+struct Stealing {
+	static auto make(size_t n)
+	{
+		return make_unique<nm::threadpool>(launch::async, n);
+	}
+};
+
 int main()
 {
 	auto f = [](int x)
@@ -40,6 +369,10 @@ int main()
 	catch (runtime_error &e) {
 		cout << e.what() << endl;
 	}
+	if (!pool.add_task_for(chrono::milliseconds(100), f, 8))
+		cout << "no room within 100ms" << endl;
+	auto sq = [](int x) { return x * x; };
+	cout << "ran on caller: " << pool.add_task_or_run(sq, 9).get() << endl;
 	pool.start();
 	pool.wait();
 	this_thread::sleep_for(chrono::seconds(1));
@@ -70,4 +403,23 @@ int main()
 	pool3.pause(); // set `is_start_` flag in destructor
 	pool3.wait();
 	cout << "done.\n";
+
+	{
+		size_t n = 200000;
+		LockedPool locked(thread::hardware_concurrency());
+		nm::threadpool pool;
+		pool.set_queue_size_limit(SIZE_MAX);
+		overhead("locked add_task",
+			 n,
+			 [&](auto f) { locked.add_task(f); });
+		overhead("add_task", n, [&](auto f) { pool.add_task(f); });
+		overhead("post", n, [&](auto f) { pool.post(f); });
+		overhead("post again", n, [&](auto f) { pool.post(f); });
+	}
+	lanes(nm::lane::interactive);
+	lanes(nm::lane::batch);
+	stop_under_load(1000);
+	algorithms();
+	scaling<Locked>("locked");
+	scaling<Stealing>("stealing");
 }
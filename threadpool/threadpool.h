@@ -8,21 +8,274 @@
 #ifndef THREAD_POOL_H_
 #define THREAD_POOL_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <future>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <stdexcept>
 #include <system_error>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace nm
 {
+namespace detail
+{
+	// Chase-Lev deque with the C11 orderings of Le et al. 2013, the owner
+	// pushes and pops at the bottom, thieves take from the top, a full
+	// ring is replaced by one twice as big, old rings are kept until the
+	// deque dies since a thief may still be reading one
+	template<typename T>
+	class WorkDeque {
+	public:
+		explicit WorkDeque(int64_t capacity = 256)
+			: array_ { new Array(capacity) }
+		{
+		}
+
+		WorkDeque(const WorkDeque &) = delete;
+		WorkDeque &operator=(const WorkDeque &) = delete;
+
+		~WorkDeque()
+		{
+			delete array_.load(std::memory_order_relaxed);
+		}
+
+		// approximate unless called by the owner
+		size_t size() const
+		{
+			auto b = bottom_.load(std::memory_order_relaxed);
+			auto t = top_.load(std::memory_order_relaxed);
+			return b > t ? static_cast<size_t>(b - t) : 0;
+		}
+
+		// owner only
+		void push(T x)
+		{
+			auto b = bottom_.load(std::memory_order_relaxed);
+			auto t = top_.load(std::memory_order_acquire);
+			auto a = array_.load(std::memory_order_relaxed);
+			if (b - t > a->size() - 1) {
+				retired_.emplace_back(a);
+				a = a->grow(b, t);
+				array_.store(a, std::memory_order_release);
+			}
+			a->put(b, x);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom_.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// owner only, newest first, nullptr if empty
+		T pop()
+		{
+			auto b = bottom_.load(std::memory_order_relaxed) - 1;
+			auto a = array_.load(std::memory_order_relaxed);
+			bottom_.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto t = top_.load(std::memory_order_relaxed);
+			if (t > b) {
+				bottom_.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			auto x = a->get(b);
+			if (t == b) {
+				// the last one, race the thieves for it
+				if (!top_.compare_exchange_strong(
+					    t,
+					    t + 1,
+					    std::memory_order_seq_cst,
+					    std::memory_order_relaxed))
+					x = nullptr;
+				bottom_.store(b + 1, std::memory_order_relaxed);
+			}
+			return x;
+		}
+
+		// any thread, oldest first, nullptr if empty or lost a race
+		T steal()
+		{
+			auto t = top_.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto b = bottom_.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+			auto x = array_.load(std::memory_order_acquire)->get(t);
+			if (!top_.compare_exchange_strong(
+				    t,
+				    t + 1,
+				    std::memory_order_seq_cst,
+				    std::memory_order_relaxed))
+				return nullptr;
+			return x;
+		}
+
+	private:
+		struct Array {
+			explicit Array(int64_t n)
+				: mask { n - 1 }, buf { new std::atomic<T>[n] }
+			{
+			}
+
+			int64_t size() const
+			{
+				return mask + 1;
+			}
+
+			T get(int64_t i) const
+			{
+				auto &x = buf[i & mask];
+				return x.load(std::memory_order_relaxed);
+			}
+
+			void put(int64_t i, T x)
+			{
+				auto &y = buf[i & mask];
+				y.store(x, std::memory_order_relaxed);
+			}
+
+			Array *grow(int64_t b, int64_t t) const
+			{
+				auto a = new Array(size() * 2);
+				for (auto i = t; i < b; ++i)
+					a->put(i, get(i));
+				return a;
+			}
+
+			int64_t mask;
+			std::unique_ptr<std::atomic<T>[]> buf;
+		};
+
+		alignas(64) std::atomic<int64_t> top_ { 0 };
+		alignas(64) std::atomic<int64_t> bottom_ { 0 };
+		std::atomic<Array *> array_;
+		std::vector<std::unique_ptr<Array>> retired_;
+	};
+
+	// a move-only void() callable in a node that the pool recycles,
+	// callables up to inline_size bytes are stored in the node itself,
+	// bigger ones go to the heap, next links the node into free lists,
+	// next and prev into the injection queue
+	class Job {
+	public:
+		static constexpr size_t inline_size = 64;
+
+		Job() = default;
+		Job(const Job &) = delete;
+		Job &operator=(const Job &) = delete;
+
+		~Job()
+		{
+			reset();
+		}
+
+		template<typename F>
+		void set(F &&f)
+		{
+			using T = std::decay_t<F>;
+			assert(!ops_);
+			if constexpr (fits<T>) {
+				::new (buf_) T(std::forward<F>(f));
+				ops_ = &inline_ops<T>;
+			} else {
+				::new (buf_) T *(new T(std::forward<F>(f)));
+				ops_ = &heap_ops<T>;
+			}
+		}
+
+		// the callable is gone afterwards, even if it throws
+		void run()
+		{
+			auto ops = std::exchange(ops_, nullptr);
+			ops->run(buf_);
+		}
+
+		// drop it without running
+		void reset()
+		{
+			if (auto ops = std::exchange(ops_, nullptr))
+				ops->destroy(buf_);
+		}
+
+		Job *next = nullptr;
+		Job *prev = nullptr;
+
+	private:
+		struct Ops {
+			void (*run)(void *);
+			void (*destroy)(void *);
+		};
+
+		template<typename T>
+		static constexpr bool fits =
+			sizeof(T) <= inline_size &&
+			alignof(T) <= alignof(std::max_align_t);
+
+		template<typename T>
+		static void destroy_inline(void *p)
+		{
+			std::destroy_at(static_cast<T *>(p));
+		}
+
+		template<typename T>
+		static void run_inline(void *p)
+		{
+			auto f = static_cast<T *>(p);
+			try {
+				(*f)();
+			}
+			catch (...) {
+				std::destroy_at(f);
+				throw;
+			}
+			std::destroy_at(f);
+		}
+
+		template<typename T>
+		static void destroy_heap(void *p)
+		{
+			delete *static_cast<T **>(p);
+		}
+
+		template<typename T>
+		static void run_heap(void *p)
+		{
+			std::unique_ptr<T> f { *static_cast<T **>(p) };
+			(*f)();
+		}
+
+		template<typename T>
+		static constexpr Ops inline_ops = { run_inline<T>,
+						    destroy_inline<T> };
+		template<typename T>
+		static constexpr Ops heap_ops = { run_heap<T>,
+						  destroy_heap<T> };
+
+		const Ops *ops_ = nullptr;
+		alignas(std::max_align_t) unsigned char buf_[inline_size];
+	};
+} // namespace detail
+
+// interactive tasks are taken before batch ones, and while there is more than
+// one worker batch tasks never occupy all of them, left out the lane is the
+// one of the task doing the adding, interactive for other threads
+enum class lane { interactive, batch };
+
+// work stealing pool, every worker owns a deque, tasks added from a worker go
+// to its own deque, tasks from other threads go through a shared injection
+// queue, a worker out of work takes from the injection queue first, then
+// steals from a random victim, and sleeps only when nothing is found
 class threadpool final {
 public:
 	threadpool() : threadpool { std::launch::async }
@@ -35,53 +288,19 @@ public:
 		, is_stop_(false)
 		, is_start_(policy_ == std::launch::async ? true : false)
 		, task_limit_(1000)
+		, batch_limit_(threads > 1 ? threads - 1 : 1)
 	{
-		for (; threads > 0; --threads) {
-			auto worker = [&]
-			{
-				for (;;) {
-					std::unique_lock<std::mutex> l(
-						queue_lock_);
-					queue_cond_.wait(
-						l,
-						[this]
-						{
-							if (!is_start_)
-								return false;
-							return is_stop_ ||
-								is_exit_ ||
-								!tasks_.empty();
-						});
-					// caller request to stop all
-					// task.
-					if (is_stop_)
-						return;
-					// normal exit, when pool is
-					// going to destroyed.
-					if (tasks_.empty()) {
-						if (is_exit_)
-							break;
-					} else {
-						auto task(std::move(
-							tasks_.front()));
-						tasks_.pop();
-						if (tasks_.empty())
-							wait_cond_.notify_one();
-						l.unlock();
-						try {
-							task();
-						}
-						catch (std::exception &e) {
-							// abort program
-							// when
-							// encounter an
-							// exception.
-							assert(false);
-						}
-					}
-				}
-			};
-			workers_.emplace_back(worker);
+		for (size_t i = 0; i < threads; ++i) {
+			auto w = std::make_unique<Worker>();
+			w->pool = this;
+			w->seed = static_cast<uint32_t>(i * 2654435761U + 1);
+			workers_.push_back(std::move(w));
+		}
+		// start only when every deque exists, they steal from each
+		// other
+		for (auto &w : workers_) {
+			auto p = w.get();
+			w->thread = std::thread([this, p] { run_(*p); });
 		}
 	}
 	threadpool(threadpool &&) = delete;
@@ -90,108 +309,732 @@ public:
 	~threadpool() noexcept
 	{
 		try {
-			std::unique_lock<std::mutex> l(queue_lock_);
+			std::unique_lock<std::mutex> l(park_lock_);
 			is_start_ = true;
 			is_exit_ = true;
-			queue_cond_.notify_all();
+			park_cond_.notify_all();
 		}
 		catch (std::system_error &) {
 			assert(false);
 		}
-		for (auto &t : workers_) {
+		for (auto &w : workers_) {
 			try {
-				t.join();
+				w->thread.join();
 			}
 			catch (std::system_error &) {
 				// do nothing.
 			}
 		}
+		drain_();
 	}
+	// the only allocation is the future's shared state as long as f and
+	// args fit in a job node, throws when the queue is full
 	template<typename F, typename... Args>
 	auto add_task(F &&f, Args &&...args)
 		-> std::future<typename std::invoke_result<F, Args...>::type>
+	{
+		return add_task(lane_(),
+				std::forward<F>(f),
+				std::forward<Args>(args)...);
+	}
+	template<typename F, typename... Args>
+	auto add_task(lane ln, F &&f, Args &&...args)
+		-> std::future<typename std::invoke_result<F, Args...>::type>
+	{
+		if (full_())
+			throw std::runtime_error("task queue is full.");
+		check_status_(__func__);
+		return enqueue_(
+			ln, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	// waits up to timeout for room in the queue, nullopt if none came,
+	// from a worker of this pool it runs f itself instead, the room it
+	// would wait for may be its own to make
+	template<typename Rep, typename Period, typename F, typename... Args>
+	auto add_task_for(const std::chrono::duration<Rep, Period> &timeout,
+			  F &&f,
+			  Args &&...args)
+		-> std::optional<std::future<
+			typename std::invoke_result<F, Args...>::type>>
+	{
+		return add_task_for(timeout,
+				    lane_(),
+				    std::forward<F>(f),
+				    std::forward<Args>(args)...);
+	}
+	template<typename Rep, typename Period, typename F, typename... Args>
+	auto add_task_for(const std::chrono::duration<Rep, Period> &timeout,
+			  lane ln,
+			  F &&f,
+			  Args &&...args)
+		-> std::optional<std::future<
+			typename std::invoke_result<F, Args...>::type>>
 	{
 		using R = typename std::invoke_result<F, Args...>::type;
-		auto task = std::make_shared<std::packaged_task<R()>>(std::bind(
-			std::forward<F>(f), std::forward<Args>(args)...));
-		auto res(task->get_future());
-		std::unique_lock<std::mutex> l(queue_lock_);
-		if (tasks_.size() >= task_limit_)
+		check_status_(__func__);
+		if (full_()) {
+			if (on_worker_())
+				return run_here_<R>(f, args...);
+			using clock = std::chrono::steady_clock;
+			auto deadline =
+				clock::now() +
+				std::chrono::ceil<clock::duration>(timeout);
+			if (!room_until_(deadline))
+				return std::nullopt;
+			check_status_(__func__);
+		}
+		return enqueue_(
+			ln, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	// when the queue is full f runs on the calling thread before this
+	// returns, which slows the caller down to the pool's pace
+	template<typename F, typename... Args>
+	auto add_task_or_run(F &&f, Args &&...args)
+		-> std::future<typename std::invoke_result<F, Args...>::type>
+	{
+		return add_task_or_run(lane_(),
+				       std::forward<F>(f),
+				       std::forward<Args>(args)...);
+	}
+	template<typename F, typename... Args>
+	auto add_task_or_run(lane ln, F &&f, Args &&...args)
+		-> std::future<typename std::invoke_result<F, Args...>::type>
+	{
+		using R = typename std::invoke_result<F, Args...>::type;
+		check_status_(__func__);
+		if (full_())
+			return run_here_<R>(f, args...);
+		return enqueue_(
+			ln, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	// fire and forget, nothing is allocated once the pool is warm as long
+	// as f and args fit in detail::Job::inline_size bytes, f must not
+	// throw
+	template<typename F, typename... Args>
+	auto post(F &&f, Args &&...args)
+		-> std::enable_if_t<std::is_invocable_v<F, Args...>>
+	{
+		post(lane_(), std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	template<typename F, typename... Args>
+	void post(lane ln, F &&f, Args &&...args)
+	{
+		if (full_())
 			throw std::runtime_error("task queue is full.");
 		check_status_(__func__);
-		tasks_.emplace([task] { (*task)(); });
-		if (policy_ == std::launch::async)
-			queue_cond_.notify_one();
-		return res; // NRVO
+		call_(ln, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	// like post, but f runs on the calling thread when the queue is full
+	template<typename F, typename... Args>
+	auto post_or_run(F &&f, Args &&...args)
+		-> std::enable_if_t<std::is_invocable_v<F, Args...>>
+	{
+		post_or_run(lane_(),
+			    std::forward<F>(f),
+			    std::forward<Args>(args)...);
+	}
+	template<typename F, typename... Args>
+	void post_or_run(lane ln, F &&f, Args &&...args)
+	{
+		check_status_(__func__);
+		if (full_()) {
+			std::invoke(f, args...);
+			return;
+		}
+		call_(ln, std::forward<F>(f), std::forward<Args>(args)...);
+	}
+	// runs one queued task on the calling thread, false if none was
+	// found, a task waiting for others helps with them this way instead
+	// of holding its worker idle, a paused pool runs too
+	bool run_one()
+	{
+		if (is_stop_)
+			return false;
+		if (!on_worker_())
+			return run_other_();
+		auto &w = *current_;
+		auto outer = w.current;
+		// a batch task keeps its slot while it helps, batch tasks it
+		// runs meanwhile use that one
+		auto held = outer == lane::batch;
+		Job *job = nullptr;
+		if (!held)
+			job = find_(w);
+		else if (!(job = find_in_(w, lane::interactive)))
+			job = find_in_(w, lane::batch);
+		if (!job)
+			return false;
+		auto slot = !held && w.current == lane::batch;
+		run_job_(job);
+		recycle_(w, job);
+		if (slot)
+			batch_done_(w);
+		w.current = outer;
+		return true;
 	}
 	size_t queue_size_limit()
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
 		check_status_(__func__);
 		return task_limit_;
 	}
 	void set_queue_size_limit(size_t size)
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
+		std::unique_lock<std::mutex> l(park_lock_);
 		check_status_(__func__);
-		auto old_limit = task_limit_;
 		task_limit_ = (size > 1 ? size : 1);
-		// if new limit less then old one,then wake up all workers_ to
-		// process as many tasks_ as they can.
-		if (task_limit_ < old_limit)
-			queue_cond_.notify_all();
+		space_cond_.notify_all();
 	}
 	void start()
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
+		std::unique_lock<std::mutex> l(park_lock_);
 		check_status_(__func__);
 		is_start_ = true;
-		queue_cond_.notify_all();
+		park_cond_.notify_all();
 	}
+	// until every queued task is taken by a worker
 	void wait()
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
+		std::unique_lock<std::mutex> l(park_lock_);
 		check_status_(__func__);
-		wait_cond_.wait(l, [&] { return tasks_.empty(); });
+		waiters_.fetch_add(1);
+		wait_cond_.wait(l, [this] { return queued_.load() == 0; });
+		waiters_.fetch_sub(1, std::memory_order_relaxed);
 	}
 	void pause()
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
+		std::unique_lock<std::mutex> l(park_lock_);
 		check_status_(__func__);
 		is_start_ = false;
 	}
+	// queued tasks are dropped, their futures get broken_promise
 	void stop()
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
-		check_status_(__func__);
-		is_stop_ = true;
-		while (!tasks_.empty())
-			tasks_.pop();
-		queue_cond_.notify_all();
+		{
+			std::unique_lock<std::mutex> l(park_lock_);
+			check_status_(__func__);
+			is_stop_ = true;
+			park_cond_.notify_all();
+			space_cond_.notify_all();
+		}
+		drain_();
 	}
 	bool valid() const
 	{
-		std::unique_lock<std::mutex> l(queue_lock_);
 		return !is_stop_;
 	}
 
 private:
+	using Job = detail::Job;
+
+	// nodes are handed out in chunks and never freed before the pool, a
+	// worker keeps the ones it ran on a list of its own and gives half back
+	// when it grows past spare_limit
+	static constexpr size_t chunk_size = 64;
+	static constexpr size_t spare_limit = 256;
+	// one pick in batch_share looks at the batch lane first, so a steady
+	// stream of interactive tasks can't stall it for good either
+	static constexpr uint32_t batch_share = 8;
+	static constexpr size_t lanes = 2;
+
+	struct alignas(64) Worker {
+		detail::WorkDeque<Job *> deque[lanes];
+		Job *spare = nullptr;
+		size_t nspare = 0;
+		threadpool *pool = nullptr;
+		uint32_t seed = 1;
+		uint32_t picks = 0;
+		lane current = lane::interactive; // of the task it runs
+		std::thread thread;
+	};
+
+	struct Inject {
+		Job *head = nullptr;
+		Job *tail = nullptr;
+		std::atomic<size_t> size { 0 };
+	};
+
 	std::launch policy_;
-	// we don't use `atomic` variable here.
-	bool is_exit_;
-	bool is_stop_;
-	bool is_start_;
-	size_t task_limit_;
-	std::vector<std::thread> workers_;
-	std::queue<std::function<void()>> tasks_;
-	mutable std::mutex queue_lock_;
-	std::condition_variable queue_cond_, wait_cond_;
+	std::atomic<bool> is_exit_;
+	std::atomic<bool> is_stop_;
+	std::atomic<bool> is_start_;
+	std::atomic<size_t> task_limit_;
+	size_t batch_limit_;
+	std::atomic<size_t> queued_ { 0 };
+	std::atomic<size_t> batch_running_ { 0 };
+	std::vector<std::unique_ptr<Worker>> workers_;
+
+	// tasks from threads that are not workers of this pool, the lock also
+	// guards the shared spare nodes
+	std::mutex inject_lock_;
+	Inject inject_[lanes];
+	Job *spare_ = nullptr;
+	std::vector<std::unique_ptr<Job[]>> chunks_;
+
+	// idle workers, wait() and add_task_for() sleep here
+	std::mutex park_lock_;
+	std::condition_variable park_cond_, wait_cond_, space_cond_;
+	std::atomic<size_t> idle_ { 0 };
+	std::atomic<bool> waking_ { false }; // a woken worker isn't looking yet
+	std::atomic<size_t> waiters_ { 0 };
+	std::atomic<size_t> blocked_ { 0 };
+
+	static inline thread_local Worker *current_ = nullptr;
+
+	bool on_worker_() const
+	{
+		return current_ && current_->pool == this;
+	}
+
+	lane lane_() const
+	{
+		return on_worker_() ? current_->current : lane::interactive;
+	}
+
+	bool full_() const
+	{
+		return queued_.load(std::memory_order_relaxed) >= task_limit_;
+	}
+
+	// false if the queue is still full at deadline
+	bool room_until_(std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> l(park_lock_);
+		blocked_.fetch_add(1);
+		auto ok = space_cond_.wait_until(
+			l, deadline, [this] { return is_stop_ || !full_(); });
+		blocked_.fetch_sub(1, std::memory_order_relaxed);
+		return ok;
+	}
+
+	template<typename F, typename... Args>
+	void call_(lane ln, F &&f, Args &&...args)
+	{
+		submit_(ln,
+			[f = std::forward<F>(f),
+			 ...args = std::forward<Args>(args)]() mutable
+			{ std::invoke(f, args...); });
+	}
+
+	template<typename F, typename... Args>
+	auto enqueue_(lane ln, F &&f, Args &&...args)
+		-> std::future<typename std::invoke_result<F, Args...>::type>
+	{
+		using R = typename std::invoke_result<F, Args...>::type;
+		std::promise<R> p;
+		auto res(p.get_future());
+		submit_(ln,
+			[p = std::move(p),
+			 f = std::forward<F>(f),
+			 ...args = std::forward<Args>(args)]() mutable
+			{ fulfil_(p, f, args...); });
+		return res; // NRVO
+	}
+
+	template<typename R, typename F, typename... Args>
+	static std::future<R> run_here_(F &f, Args &...args)
+	{
+		std::promise<R> p;
+		auto res(p.get_future());
+		fulfil_(p, f, args...);
+		return res;
+	}
+
+	template<typename R, typename F, typename... Args>
+	static void fulfil_(std::promise<R> &p, F &f, Args &...args)
+	{
+		try {
+			if constexpr (std::is_void_v<R>) {
+				std::invoke(f, args...);
+				p.set_value();
+			} else {
+				p.set_value(std::invoke(f, args...));
+			}
+		}
+		catch (...) {
+			p.set_exception(std::current_exception());
+		}
+	}
+
 	void check_status_(const std::string &func)
 	{
 		if (is_stop_)
 			throw std::runtime_error(func +
 						 " on stopped threadpool.");
 	}
+
+	template<typename F>
+	void submit_(lane ln, F &&fn)
+	{
+		auto i = static_cast<size_t>(ln);
+		if (on_worker_()) {
+			auto &w = *current_;
+			auto job = local_job_(w);
+			try {
+				job->set(std::forward<F>(fn));
+			}
+			catch (...) {
+				recycle_(w, job);
+				throw;
+			}
+			queued_.fetch_add(1, std::memory_order_relaxed);
+			w.deque[i].push(job);
+		} else {
+			std::lock_guard<std::mutex> l(inject_lock_);
+			// stop() came after check_status_(), drain_() may be
+			// done already, fn is dropped with the caller's copy
+			if (is_stop_)
+				return;
+			auto job = spare_job_();
+			try {
+				job->set(std::forward<F>(fn));
+			}
+			catch (...) {
+				job->next = std::exchange(spare_, job);
+				throw;
+			}
+			queued_.fetch_add(1, std::memory_order_relaxed);
+			auto &q = inject_[i];
+			job->prev = q.tail;
+			if (q.tail)
+				q.tail->next = job;
+			else
+				q.head = job;
+			q.tail = job;
+			q.size.fetch_add(1, std::memory_order_relaxed);
+		}
+		wake_();
+		// the same for a worker, drain_() may have swept its deque
+		// before the push, the fence in wake_() pairs with drain_()
+		if (on_worker_() && is_stop_.load(std::memory_order_relaxed))
+			drop_local_(*current_);
+	}
+
+	// inject_lock_ held
+	Job *spare_job_()
+	{
+		if (!spare_) {
+			auto c = std::make_unique<Job[]>(chunk_size);
+			for (size_t i = 0; i < chunk_size; ++i)
+				c[i].next = std::exchange(spare_, &c[i]);
+			chunks_.push_back(std::move(c));
+		}
+		auto job = spare_;
+		spare_ = std::exchange(job->next, nullptr);
+		return job;
+	}
+
+	Job *local_job_(Worker &w)
+	{
+		if (!w.spare) {
+			std::lock_guard<std::mutex> l(inject_lock_);
+			for (; w.nspare < chunk_size / 2; ++w.nspare) {
+				auto job = spare_job_();
+				job->next = std::exchange(w.spare, job);
+			}
+		}
+		auto job = w.spare;
+		w.spare = std::exchange(job->next, nullptr);
+		--w.nspare;
+		return job;
+	}
+
+	void recycle_(Worker &w, Job *job)
+	{
+		job->next = std::exchange(w.spare, job);
+		if (++w.nspare < spare_limit)
+			return;
+		std::lock_guard<std::mutex> l(inject_lock_);
+		for (; w.nspare > spare_limit / 2; --w.nspare) {
+			auto p = w.spare;
+			w.spare = std::exchange(p->next, spare_);
+			spare_ = p;
+		}
+	}
+
+	// what stop() left in the deques of a worker that pushed late
+	void drop_local_(Worker &w)
+	{
+		for (auto &d : w.deque) {
+			while (auto job = d.pop()) {
+				taken_();
+				job->reset();
+				recycle_(w, job);
+			}
+		}
+	}
+
+	// the fence pairs with the one in park_, either the worker going to
+	// sleep sees the task or we see it idle, only one worker is woken at
+	// a time, it wakes the next if it finds more work than it can take
+	void wake_()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (idle_.load(std::memory_order_relaxed) != 0 &&
+		    is_start_.load(std::memory_order_relaxed) &&
+		    !waking_.exchange(true)) {
+			std::lock_guard<std::mutex> l(park_lock_);
+			park_cond_.notify_one();
+		}
+	}
+
+	void taken_()
+	{
+		auto n = queued_.fetch_sub(1);
+		auto idle = n == 1 && waiters_.load() != 0;
+		auto room = n <= task_limit_ && blocked_.load() != 0;
+		if (!idle && !room)
+			return;
+		std::lock_guard<std::mutex> l(park_lock_);
+		if (idle)
+			wait_cond_.notify_all();
+		if (room)
+			space_cond_.notify_one();
+	}
+
+	void run_(Worker &w)
+	{
+		current_ = &w;
+		for (;;) {
+			Job *job = nullptr;
+			if (is_start_ && !is_stop_)
+				job = find_(w);
+			if (!job) {
+				if (park_())
+					continue;
+				return;
+			}
+			run_job_(job);
+			recycle_(w, job);
+			if (w.current == lane::batch)
+				batch_done_(w);
+		}
+	}
+
+	void run_job_(Job *job)
+	{
+		taken_();
+		if (idle_.load(std::memory_order_relaxed) != 0 && has_work_())
+			wake_();
+		try {
+			job->run();
+		}
+		catch (std::exception &e) {
+			// abort program when encounter an exception.
+			assert(false);
+		}
+	}
+
+	// run_one() from a thread that is not a worker of this pool, it has
+	// no deque, so it takes the newest injected task, likely one it just
+	// added itself, the oldest would nest unrelated work ever deeper in
+	// its stack, the node goes back to the shared spares
+	bool run_other_()
+	{
+		static thread_local uint32_t seed = 1;
+		Job *job = nullptr;
+		for (size_t i = 0; i < lanes && !job; ++i) {
+			if (inject_[i].size.load(std::memory_order_relaxed)) {
+				std::lock_guard<std::mutex> l(inject_lock_);
+				auto &q = inject_[i];
+				if ((job = q.tail)) {
+					if ((q.tail = job->prev))
+						q.tail->next = nullptr;
+					else
+						q.head = nullptr;
+					q.size.fetch_sub(
+						1, std::memory_order_relaxed);
+				}
+			}
+			if (!job)
+				job = steal_(seed, nullptr, i);
+		}
+		if (!job)
+			return false;
+		run_job_(job);
+		std::lock_guard<std::mutex> l(inject_lock_);
+		job->next = std::exchange(spare_, job);
+		return true;
+	}
+
+	// a batch task may have waited for this slot
+	void batch_done_(Worker &w)
+	{
+		w.current = lane::interactive;
+		batch_running_.fetch_sub(1);
+		if (idle_.load(std::memory_order_relaxed) != 0 && has_work_())
+			wake_();
+	}
+
+	Job *find_(Worker &w)
+	{
+		if (++w.picks % batch_share == 0) {
+			if (auto job = find_batch_(w))
+				return job;
+			return find_in_(w, lane::interactive);
+		}
+		if (auto job = find_in_(w, lane::interactive))
+			return job;
+		return find_batch_(w);
+	}
+
+	// only batch_limit_ workers run batch tasks at a time
+	Job *find_batch_(Worker &w)
+	{
+		if (batch_running_.fetch_add(1) < batch_limit_) {
+			if (auto job = find_in_(w, lane::batch))
+				return job;
+		}
+		batch_running_.fetch_sub(1);
+		return nullptr;
+	}
+
+	Job *find_in_(Worker &w, lane ln)
+	{
+		auto i = static_cast<size_t>(ln);
+		auto job = w.deque[i].pop();
+		if (!job)
+			job = take_injected_(w, i);
+		if (!job)
+			job = steal_(w.seed, &w, i);
+		if (job)
+			w.current = ln;
+		return job;
+	}
+
+	// take one and move a share of the rest to our deque, so the lock is
+	// taken once per batch rather than once per task
+	Job *take_injected_(Worker &w, size_t i)
+	{
+		auto &q = inject_[i];
+		if (q.size.load(std::memory_order_relaxed) == 0)
+			return nullptr;
+		std::unique_lock<std::mutex> l(inject_lock_);
+		auto job = q.head;
+		if (!job)
+			return nullptr;
+		Job *batch[32];
+		auto left = q.size.load(std::memory_order_relaxed) - 1;
+		auto n = std::min<size_t>(left / workers_.size(), 32);
+		auto p = job->next;
+		for (size_t i = 0; i < n; ++i, p = p->next)
+			batch[i] = p;
+		q.head = p;
+		if (p)
+			p->prev = nullptr;
+		else
+			q.tail = nullptr;
+		q.size.fetch_sub(n + 1, std::memory_order_relaxed);
+		l.unlock();
+		// newest first, pop() then runs them in the order they came
+		for (auto k = n; k > 0; --k)
+			w.deque[i].push(batch[k - 1]);
+		// drain_() may have found the list and the deque empty while
+		// the batch was in hand, as in submit_() either we see is_stop_
+		// or it sees the batch
+		if (n) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (is_stop_.load(std::memory_order_relaxed))
+				drop_local_(w);
+		}
+		return job;
+	}
+
+	Job *steal_(uint32_t &seed, const Worker *self, size_t i)
+	{
+		auto n = workers_.size();
+		if (n == 0)
+			return nullptr;
+		// xorshift, a fixed order would pile every thief on one victim
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		for (size_t k = 0; k < n * 2; ++k) {
+			auto &v = *workers_[(seed + k) % n];
+			if (&v == self)
+				continue;
+			if (auto job = v.deque[i].steal())
+				return job;
+		}
+		return nullptr;
+	}
+
+	// batch work counts only while a worker may take it
+	bool has_work_() const
+	{
+		if (has_work_(lane::interactive))
+			return true;
+		return batch_running_.load() < batch_limit_ &&
+		       has_work_(lane::batch);
+	}
+
+	bool has_work_(lane ln) const
+	{
+		auto i = static_cast<size_t>(ln);
+		if (inject_[i].size.load(std::memory_order_relaxed) != 0)
+			return true;
+		for (auto &w : workers_) {
+			if (w->deque[i].size() != 0)
+				return true;
+		}
+		return false;
+	}
+
+	// false when the worker should exit
+	bool park_()
+	{
+		std::unique_lock<std::mutex> l(park_lock_);
+		idle_.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// a wake_() while waking_ is set is skipped, so clear it before
+		// every look for work, also when the wait goes back to sleep
+		park_cond_.wait(l,
+				[this]
+				{
+					waking_.store(false);
+					std::atomic_thread_fence(
+						std::memory_order_seq_cst);
+					if (is_stop_)
+						return true;
+					if (!is_start_)
+						return false;
+					return is_exit_ || has_work_();
+				});
+		idle_.fetch_sub(1, std::memory_order_relaxed);
+		return !is_stop_ && !(is_exit_ && !has_work_());
+	}
+
+	// drop whatever is queued, workers are stopped or gone
+	void drain_()
+	{
+		std::vector<Job *> jobs;
+		{
+			std::lock_guard<std::mutex> l(inject_lock_);
+			for (auto &q : inject_) {
+				for (auto p = q.head; p; p = p->next)
+					jobs.push_back(p);
+				q.head = q.tail = nullptr;
+				q.size.store(0, std::memory_order_relaxed);
+			}
+		}
+		// pairs with the fence a worker makes after a push, either it
+		// sees is_stop_ or we see the job
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (auto &w : workers_) {
+			for (auto &d : w->deque) {
+				while (d.size() != 0) {
+					if (auto job = d.steal())
+						jobs.push_back(job);
+				}
+			}
+		}
+		for (auto job : jobs) {
+			taken_();
+			job->reset();
+		}
+		std::lock_guard<std::mutex> l(inject_lock_);
+		for (auto job : jobs)
+			job->next = std::exchange(spare_, job);
+	}
 };
 
 }